@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "function.h"
+#include "geneticalgo.h"
+#include "jit.h"
+#include "kernel.h"
+#include "metrics.h"
+#include "program.h"
+#include "rng.h"
+#ifdef SMARTGA_BENCH_DETECTION
+#include "detectobject.h"
+#endif
+
+// Times the library's hot paths and prints one JSON document, so runs of
+// different versions can be compared mechanically.
+//
+//   smartga_bench [--min-time SECONDS] [--filter SUBSTRING] [--output FILE]
+
+// Every heap allocation in the process is counted, so each case can report
+// how many it makes per iteration.
+namespace {
+std::atomic<size_t> allocation_count{0};
+}
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+
+struct Options {
+    double min_time = 0.2;
+    std::string filter;
+    std::string output;
+};
+
+struct Result {
+    std::string name;
+    std::vector<std::pair<std::string, double>> parameters;
+    size_t iterations = 0;
+    double median_ns = 0.0;
+    double min_ns = 0.0;
+    double allocations = 0.0;
+    // Per-iteration work used for the derived rate (samples, instructions...).
+    double items = 0.0;
+};
+
+constexpr int kRepetitions = 5;
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedNs(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Grows the batch until it takes a fifth of `min_time`, then reports the
+// median and fastest of kRepetitions batches per iteration.
+void measure(Result& result, double min_time, const std::function<void()>& body) {
+    body();
+    size_t batch = 1;
+    while (true) {
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+            body();
+        }
+        double ns = elapsedNs(start);
+        if (ns >= min_time * 1e9 / kRepetitions || batch >= (size_t(1) << 30)) {
+            break;
+        }
+        batch = ns <= 0.0 ? batch * 10 : std::max(batch * 2, static_cast<size_t>(batch * (min_time * 1e9 / kRepetitions) / ns * 1.2));
+    }
+    std::vector<double> per_iteration;
+    per_iteration.reserve(kRepetitions);
+    const size_t allocations_before = allocation_count.load(std::memory_order_relaxed);
+    for (int r = 0; r < kRepetitions; ++r) {
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+            body();
+        }
+        per_iteration.push_back(elapsedNs(start) / batch);
+    }
+    const size_t allocations = allocation_count.load(std::memory_order_relaxed) - allocations_before;
+    std::sort(per_iteration.begin(), per_iteration.end());
+    result.iterations = batch * kRepetitions;
+    result.allocations = static_cast<double>(allocations) / result.iterations;
+    result.median_ns = per_iteration[kRepetitions / 2];
+    result.min_ns = per_iteration.front();
+}
+
+// Random instructions drawn from the GA's own mutation set, so the opcode
+// mix matches what evolution produces.
+std::string randomInstructions(Rng& rng, size_t length) {
+    static const char* const operations[] = {"y = y + 1", "y = y - 1", "y = y * 2", "y = y / 2", "y = sin(y)", "y = cos(y)", "y = ln(y)"};
+    std::string instructions = "y = x";
+    for (size_t i = 0; i < length; ++i) {
+        instructions += ", ";
+        instructions += operations[rng.uniform(std::size(operations))];
+    }
+    return instructions;
+}
+
+std::vector<double> linearSamples(size_t count) {
+    std::vector<double> values(count);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = 1.0 + 0.001 * static_cast<double>(i);
+    }
+    return values;
+}
+
+class Suite {
+public:
+    explicit Suite(const Options& options) : options(options) {}
+
+    bool selected(const std::string& name) const {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    void add(Result result, const std::function<void()>& body) {
+        measure(result, options.min_time, body);
+        fprintf(stderr, "%-20s %12.1f ns %10.2f allocations\n", result.name.c_str(), result.median_ns, result.allocations);
+        results.push_back(std::move(result));
+    }
+
+    const std::vector<Result>& getResults() const {
+        return results;
+    }
+
+private:
+    Options options;
+    std::vector<Result> results;
+};
+
+void benchCalculate(Suite& suite) {
+    if (!suite.selected("function_calculate")) {
+        return;
+    }
+    for (size_t length : {2, 8, 32}) {
+        for (size_t samples : {256, 4096, 65536}) {
+            Rng rng(42, length);
+            Function function = Function::createFromInstructions(randomInstructions(rng, length));
+            std::vector<double> x_values = linearSamples(samples);
+            std::vector<double> y_values(samples);
+            Result result{"function_calculate", {{"program_length", double(length)}, {"samples", double(samples)}}};
+            result.items = static_cast<double>(samples);
+            suite.add(result, [&] {
+                function.calculate(x_values, y_values.data());
+            });
+        }
+    }
+}
+
+void benchEvaluateSimilarity(Suite& suite) {
+    if (!suite.selected("evaluate_similarity")) {
+        return;
+    }
+    for (size_t samples : {256, 4096, 65536}) {
+        Function function = Function::createFromInstructions("y = x, y = y * 2");
+        std::vector<double> calculated = linearSamples(samples);
+        std::vector<double> desired(samples);
+        for (size_t i = 0; i < samples; ++i) {
+            desired[i] = std::sin(calculated[i]);
+        }
+        Result result{"evaluate_similarity", {{"samples", double(samples)}}};
+        result.items = static_cast<double>(samples);
+        suite.add(result, [&] {
+            function.evaluateSimilarity(calculated, desired);
+        });
+    }
+}
+
+// Parsing to the canonical form and formatting back, as every mutation and
+// constant refinement does.
+void benchFormatInstruction(Suite& suite) {
+    if (!suite.selected("format_instruction")) {
+        return;
+    }
+    static const char* const instructions[] = {"y = y + 1", "y=y-0.25", "y = y * 3.7000000000000002", "y = y / 2", "y = y ^ -1.5", "y = ln(y)", "y = sin( y )", "y = 1e-05"};
+    std::string normalized;
+    std::string formatted;
+    Result result{"format_instruction", {{"instructions", double(std::size(instructions))}}};
+    result.items = static_cast<double>(std::size(instructions));
+    suite.add(result, [&] {
+        for (const char* text : instructions) {
+            formatted = formatInstruction(parseInstruction(text, normalized));
+        }
+    });
+}
+
+// Scoring one program with the interpreter kernel and with native code, for
+// arithmetic-only programs (compiled whole) and mixed ones (ln, sin and cos
+// still go through the kernel).
+void benchProgramScore(Suite& suite) {
+    if (!suite.selected("program_score")) {
+        return;
+    }
+    static const char* const arithmetic[] = {"y = y + 1", "y = y - 0.5", "y = y * 2", "y = y / 3"};
+    static const char* const mixed[] = {"y = y + 1", "y = y - 0.5", "y = y * 2", "y = y / 3", "y = sin(y)", "y = cos(y)", "y = ln(y)"};
+    for (bool arithmetic_only : {true, false}) {
+        for (size_t length : {8, 32}) {
+            for (size_t samples : {4096, 65536}) {
+                Rng rng(7, length);
+                std::string instructions = "y = x";
+                for (size_t i = 0; i < length; ++i) {
+                    instructions += ", ";
+                    instructions += arithmetic_only ? arithmetic[rng.uniform(std::size(arithmetic))] : mixed[rng.uniform(std::size(mixed))];
+                }
+                const Program program = Function::createFromInstructions(instructions).getProgram();
+                std::vector<double> x_values = linearSamples(samples);
+                std::vector<double> desired(samples);
+                for (size_t i = 0; i < samples; ++i) {
+                    desired[i] = std::sin(x_values[i]);
+                }
+                std::unique_ptr<JitProgram> native = JitProgram::compile(program);
+                for (bool jit : {false, true}) {
+                    if (jit && !native) {
+                        continue;
+                    }
+                    Result result{"program_score", {{"arithmetic_only", arithmetic_only ? 1.0 : 0.0}, {"program_length", double(length)}, {"samples", double(samples)}, {"jit", jit ? 1.0 : 0.0}}};
+                    result.items = static_cast<double>(samples);
+                    suite.add(result, [&] {
+                        if (jit) {
+                            native->evaluateScore(x_values.data(), desired.data(), samples, nullptr);
+                        } else {
+                            evaluateProgramScore(program, x_values.data(), desired.data(), samples, nullptr);
+                        }
+                    });
+                }
+            }
+        }
+    }
+}
+
+void benchGeneration(Suite& suite) {
+    if (!suite.selected("ga_generation")) {
+        return;
+    }
+    const size_t samples = 1000;
+    std::vector<double> x_values = linearSamples(samples);
+    std::vector<double> desired(samples);
+    for (size_t i = 0; i < samples; ++i) {
+        desired[i] = 2.5 * std::sin(x_values[i]) + 0.3;
+    }
+    const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (int population : {64, 256, 1024}) {
+        for (size_t threads : {size_t(1), hardware}) {
+            // With metrics on, the recorder is sized so no span is dropped.
+            for (bool metrics : {false, true}) {
+                GeneticAlgorithmOptions options;
+                options.thread_count = threads;
+                if (metrics) {
+                    options.metrics = std::make_shared<MetricsRecorder>(size_t(1) << 20);
+                }
+                GeneticAlgorithm ga(std::span<const double>(x_values), std::span<const double>(desired), population, 1, options);
+                ga.initialize();
+                // Lets the population buffers reach their steady-state sizes.
+                for (int warm_up = 0; warm_up < 20; ++warm_up) {
+                    ga.step();
+                }
+                Result result{"ga_generation", {{"population", double(population)}, {"samples", double(samples)}, {"threads", double(threads)}, {"metrics", metrics ? 1.0 : 0.0}}};
+                result.items = static_cast<double>(population);
+                suite.add(result, [&] {
+                    ga.step();
+                });
+            }
+            if (hardware == 1) {
+                break;
+            }
+        }
+    }
+}
+
+#ifdef SMARTGA_BENCH_DETECTION
+// Balls of the detector's default radius range on a noisy background.
+cv::Mat syntheticFrame(int width, int height, int circles) {
+    cv::Mat frame(height, width, CV_8UC3);
+    cv::RNG rng(7);
+    rng.fill(frame, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(40));
+    for (int c = 0; c < circles; ++c) {
+        cv::Point center(width * (c + 1) / (circles + 1), height / 2 + (c % 2 == 0 ? -height / 6 : height / 6));
+        cv::circle(frame, center, 20 + 5 * (c % 3), cv::Scalar(230, 230, 230), cv::FILLED);
+    }
+    return frame;
+}
+
+void benchDetectCircles(Suite& suite) {
+    if (!suite.selected("detect_circles")) {
+        return;
+    }
+    DetectObject detector;
+    for (auto [width, height] : {std::pair{320, 240}, std::pair{640, 480}, std::pair{1280, 720}}) {
+        cv::Mat frame = syntheticFrame(width, height, 3);
+        Result result{"detect_circles", {{"width", double(width)}, {"height", double(height)}, {"circles", 3.0}}};
+        result.items = 1.0;
+        suite.add(result, [&] {
+            detector.detectFrame(frame, {"circle"});
+        });
+    }
+}
+#endif
+
+std::string formatNumber(double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.6g", value);
+    return buffer;
+}
+
+std::string toJson(const std::vector<Result>& results) {
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::string json = "{\n";
+    json += "  \"version\": \"" SMARTGA_VERSION "\",\n";
+    json += "  \"timestamp\": \"" + std::string(timestamp) + "\",\n";
+    json += "  \"instruction_set\": \"" + std::string(kernelInstructionSet()) + "\",\n";
+    json += "  \"hardware_threads\": " + std::to_string(std::thread::hardware_concurrency()) + ",\n";
+    json += "  \"repetitions\": " + std::to_string(kRepetitions) + ",\n";
+    json += "  \"results\": [";
+    for (size_t r = 0; r < results.size(); ++r) {
+        const Result& result = results[r];
+        json += r == 0 ? "\n" : ",\n";
+        json += "    {\"name\": \"" + result.name + "\", \"parameters\": {";
+        for (size_t p = 0; p < result.parameters.size(); ++p) {
+            json += (p == 0 ? "\"" : ", \"") + result.parameters[p].first + "\": " + formatNumber(result.parameters[p].second);
+        }
+        json += "}, \"iterations\": " + std::to_string(result.iterations);
+        json += ", \"median_ns\": " + formatNumber(result.median_ns);
+        json += ", \"min_ns\": " + formatNumber(result.min_ns);
+        json += ", \"ns_per_item\": " + formatNumber(result.median_ns / result.items);
+        json += ", \"allocations_per_iteration\": " + formatNumber(result.allocations) + "}";
+    }
+    json += "\n  ]\n}\n";
+    return json;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            options.min_time = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--min-time SECONDS] [--filter SUBSTRING] [--output FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Suite suite(options);
+    benchCalculate(suite);
+    benchEvaluateSimilarity(suite);
+    benchFormatInstruction(suite);
+    benchProgramScore(suite);
+    benchGeneration(suite);
+#ifdef SMARTGA_BENCH_DETECTION
+    benchDetectCircles(suite);
+#endif
+
+    std::string json = toJson(suite.getResults());
+    FILE* out = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Could not open %s\n", options.output.c_str());
+        return 1;
+    }
+    fputs(json.c_str(), out);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef BATCHEVALUATOR_H
+#define BATCHEVALUATOR_H
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+#include "function.h"
+#include "kernel.h"
+#include "metrics.h"
+#include "threadpool.h"
+
+// Scores a whole population against one series in a single pass. Programs are
+// grouped by opcode sequence and stored as structure-of-arrays (operand k of
+// every candidate in a group is contiguous), so each opcode is dispatched once
+// per tile of candidates while the current block of samples stays in cache.
+class BatchEvaluator {
+public:
+    static constexpr size_t kTileSize = 16;
+
+    void load(const std::vector<Function>& population);
+
+    // Loads only the listed candidates; getScores() stays indexed by position
+    // in `population` and entries outside `indices` are left untouched.
+    void load(const std::vector<Function>& population, const std::vector<uint32_t>& indices);
+
+    // Tiles are spread over the pool when one is given. With a `series`
+    // layout the inputs are concatenated series: every program still runs
+    // once over all samples, and errors are kept per series and aggregated.
+    //
+    // Candidates race against `cutoff`: after every block of samples each
+    // one's final score is bounded from its partial error (which can only
+    // grow), and a candidate is abandoned once that bound falls below the
+    // cutoff. An abandoned candidate's score is its bound, so it still ranks
+    // below anything scoring at least `cutoff`.
+    void evaluate(std::span<const double> x_values, std::span<const double> desired_output, ThreadPool* pool = nullptr, const SeriesLayout* series = nullptr, double cutoff = -std::numeric_limits<double>::infinity());
+
+    // Each chunk of tiles is recorded as an "evaluate_tiles" span; null
+    // (the default) records nothing.
+    void setMetrics(MetricsRecorder* recorder);
+
+    const std::vector<double>& getScores() const;
+
+    // Indexed like getScores(); nonzero where the last evaluate() abandoned
+    // the candidate.
+    const std::vector<uint8_t>& getAbandoned() const;
+
+    // Samples the last evaluate() skipped, summed over abandoned candidates.
+    size_t getSkippedSamples() const;
+
+private:
+    struct Tile {
+        size_t first_candidate;
+        size_t candidate_count;
+        size_t first_opcode;
+        size_t opcode_count;
+        size_t first_operand;
+    };
+
+    std::vector<uint32_t> order;
+    std::vector<OpCode> opcodes;
+    std::vector<double> operands;
+    std::vector<Tile> tiles;
+    // Candidate-major, one entry per series.
+    std::vector<ErrorSums> sums;
+    std::vector<double> scores;
+    std::vector<uint8_t> abandoned;
+    // Racing state of the current evaluate(); candidates are swapped to the
+    // end of their tile when abandoned, so these follow `order`.
+    double cutoff = -std::numeric_limits<double>::infinity();
+    bool per_series = false;
+    MetricsRecorder* metrics = nullptr;
+    std::vector<uint8_t> abandoned_positions;
+    std::vector<size_t> tile_skipped;
+
+    void loadOrder(const std::vector<Function>& population);
+    void evaluateTiles(size_t tile_begin, size_t tile_end, const double* x_values, const double* desired_output, size_t count, const SeriesLayout& series);
+    double scoreBound(size_t position, const SeriesLayout& series, std::vector<ErrorSums>& scratch) const;
+    void swapCandidates(const Tile& tile, size_t a, size_t b, size_t series_count);
+};
+
+#endif // BATCHEVALUATOR_H
@@ -0,0 +1,93 @@
+#ifndef BATCHFITTER_H
+#define BATCHFITTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+#include "function.h"
+#include "gaoptions.h"
+#include "threadpool.h"
+
+struct FitResult {
+    // Set when the job was cancelled before it finished; `summary` is empty.
+    bool cancelled = false;
+    // best_function_expression, best_function_instructions (every
+    // instruction, comma-separated), score and track_str_infor, as main.cpp
+    // reports them.
+    std::map<std::string, std::string> summary;
+    // Survivors of the last generation, best first; pass them as another
+    // job's warm start.
+    std::vector<Program> best_programs;
+};
+
+// Runs one GeneticAlgorithm per series, spread over a shared thread pool.
+// Each GA runs single-threaded; the parallelism is across series. Jobs start
+// in priority order (higher first), and among equal priorities the shortest
+// series start first so they do not queue behind long ones. Jobs share one
+// fitness cache (options.cache_capacity); entries are keyed by data set, so
+// only jobs fitting identical series see each other's scores, and their
+// results then depend on which job ran first.
+class BatchFitter {
+public:
+    // Uses `pool` when given, otherwise a pool of options.thread_count threads.
+    BatchFitter(int population_size, int generations, const GeneticAlgorithmOptions& options = GeneticAlgorithmOptions(), ThreadPool* pool = nullptr);
+
+    // Returns the job id, which is also its index in run()'s result. Jobs
+    // cannot be added while run() is in progress. Every series is kept, so
+    // options.fit_all_series applies; the summary scores series 0.
+    size_t add(const std::vector<std::vector<double>>& time_value, const std::vector<std::vector<double>>& desired_output, int priority = 0);
+
+    // Reads the series in place, e.g. from a TrackStore; they must stay alive
+    // until run() returns. Throws std::invalid_argument when the two spans
+    // differ in length. A non-empty `warm_start` replaces the options' one
+    // for this job.
+    size_t add(std::span<const double> time_value, std::span<const double> desired_output, int priority = 0, std::vector<Program> warm_start = {});
+
+    // Safe to call from any thread. A queued job is skipped; a running one
+    // stops at its next generation boundary.
+    void cancel(size_t job);
+
+    void cancelAll();
+
+    // Blocks until every job finished or was cancelled; results are in job id
+    // order. Jobs are cleared afterwards so the fitter can be reused.
+    std::vector<FitResult> run();
+
+    static std::map<std::string, std::string> summarize(Function& function, std::span<const double> time_value, std::span<const double> desired_output);
+
+private:
+    struct Job {
+        // Series owned by jobs added from vectors; the spans view the first
+        // of these or caller-owned data.
+        std::vector<std::vector<double>> owned_time;
+        std::vector<std::vector<double>> owned_desired;
+        std::span<const double> time_value;
+        std::span<const double> desired_output;
+        // Samples over all series, for the start order.
+        size_t sample_count;
+        size_t id;
+        int priority;
+        std::vector<Program> warm_start;
+        std::atomic<bool> cancelled{false};
+    };
+
+    int population_size;
+    int generations;
+    GeneticAlgorithmOptions options;
+    std::unique_ptr<ThreadPool> owned_pool;
+    ThreadPool* pool;
+    // Deque so job addresses stay stable for cancel(); the mutex keeps
+    // cancel() from reading it while it is changed.
+    std::deque<Job> jobs;
+    std::mutex jobs_mutex;
+
+    FitResult fit(Job& job);
+};
+
+#endif // BATCHFITTER_H
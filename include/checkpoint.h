@@ -0,0 +1,41 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "program.h"
+
+// Everything a GeneticAlgorithm needs to continue a run between two steps.
+// Random draws derive from (seed, generation, individual index), so the seed
+// and the generation are the whole generator state.
+struct GaCheckpoint {
+    uint64_t seed = 0;
+    uint64_t dataset_id = 0;
+    int population_size = 0;
+    int generation = 0;
+    // The first `survivor_count` programs are the last selection's
+    // survivors, best first; the rest are their children.
+    size_t survivor_count = 0;
+    double best_score = 0.0;
+    size_t skipped_samples = 0;
+    std::vector<Program> programs;
+    std::vector<double> scores;
+
+    // Up to `count` survivors, best first, e.g. as another run's warm start.
+    std::vector<Program> getBestPrograms(size_t count) const;
+};
+
+// Binary file: a fixed header, then per-program lengths, scores, opcodes and
+// operands as flat arrays, then a checksum of everything before it. The file
+// is written next to `path` and renamed over it, so a run killed while saving
+// leaves the previous checkpoint intact. Throws std::runtime_error when the
+// file cannot be written.
+void saveCheckpoint(const std::string& path, const GaCheckpoint& checkpoint);
+
+// Throws std::runtime_error when the file is missing, truncated, corrupt or
+// of another format version.
+GaCheckpoint loadCheckpoint(const std::string& path);
+
+#endif // CHECKPOINT_H
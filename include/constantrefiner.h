@@ -0,0 +1,18 @@
+#ifndef CONSTANTREFINER_H
+#define CONSTANTREFINER_H
+
+#include <cstddef>
+#include <span>
+#include "program.h"
+
+// Tunes the operands of the Add, Sub, Mul, Div, Pow and Set ops of `program`
+// to minimize the sum of squared errors against `desired_output`, with
+// Levenberg–Marquardt. The Jacobian is exact: y and its derivative with
+// respect to every operand are carried forward through the op chain for
+// each sample. A step is only taken when it lowers the error, and the loop
+// stops after `max_iterations` steps or once progress stalls. Returns the
+// final sum of squared errors (infinity when it is undefined at the start,
+// in which case the program is left unchanged).
+double refineConstants(Program& program, std::span<const double> x_values, std::span<const double> desired_output, size_t max_iterations);
+
+#endif // CONSTANTREFINER_H
@@ -0,0 +1,111 @@
+#ifndef DETECTIONCACHE_H
+#define DETECTIONCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct FileStamp {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+};
+
+// On-disk detection results, one entry per (image path, shape type,
+// detection parameters). The file is a header, a key-sorted entry table and
+// one flat position array; it is memory-mapped and searched in place, so
+// loading costs nothing per entry. An entry only hits while the image's size
+// and modification time still match, so changed frames are re-detected.
+// New results are kept in memory until save() rewrites the file.
+class DetectionCache {
+public:
+    // A position as stored in the file.
+    struct FilePosition {
+        int32_t x;
+        int32_t y;
+    };
+
+    // A missing, unreadable or malformed file starts an empty cache.
+    explicit DetectionCache(const std::string& path);
+    ~DetectionCache();
+
+    DetectionCache(const DetectionCache&) = delete;
+    DetectionCache& operator=(const DetectionCache&) = delete;
+
+    // Returns false when the file cannot be stat'ed.
+    static bool stampFile(const std::string& image_path, FileStamp& stamp);
+
+    bool lookup(const std::string& image_path, const FileStamp& stamp, const std::string& shape, uint64_t parameters_hash, std::vector<std::pair<int, int>>& positions);
+
+    // Reads a saved entry in place, without copying its positions. The span
+    // stays valid until the next save() or invalidate(). Entries inserted
+    // since the last save() are not visible here and count as misses.
+    bool lookupMapped(const std::string& image_path, const FileStamp& stamp, const std::string& shape, uint64_t parameters_hash, std::span<const FilePosition>& positions);
+
+    void insert(const std::string& image_path, const FileStamp& stamp, const std::string& shape, uint64_t parameters_hash, const std::vector<std::pair<int, int>>& positions);
+
+    // Forgets every entry, mapped or pending; the next save() rebuilds the
+    // file from whatever is inserted afterwards.
+    void invalidate();
+
+    // Writes pending entries and the mapped entries a lookup hit since the
+    // file was mapped to a temporary file, renames it over the cache file
+    // and maps the result. Entries of deleted, changed or unprocessed images
+    // are therefore dropped, so the file does not grow across runs. Does
+    // nothing without new entries (or an invalidate()).
+    void save();
+
+    size_t getHits() const;
+
+    size_t getMisses() const;
+
+private:
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t entry_count;
+        uint64_t position_count;
+    };
+
+    struct FileEntry {
+        uint64_t key;
+        uint64_t check;
+        uint64_t file_size;
+        int64_t mtime_ns;
+        uint64_t first_position;
+        uint64_t position_count;
+    };
+
+    struct PendingEntry {
+        uint64_t check;
+        FileStamp stamp;
+        std::vector<std::pair<int, int>> positions;
+    };
+
+    std::string path;
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    const FileEntry* entries = nullptr;
+    const FilePosition* positions = nullptr;
+    size_t entry_count = 0;
+    size_t mapped_position_count = 0;
+    // One flag per mapped entry, set when a lookup hits it.
+    std::vector<uint8_t> used;
+    std::map<uint64_t, PendingEntry> pending;
+    bool dirty = false;
+    size_t hits = 0;
+    size_t misses = 0;
+    mutable std::mutex mutex;
+
+    void map();
+    void unmap();
+    const FileEntry* findMapped(uint64_t key) const;
+    const FileEntry* matchMapped(uint64_t key, uint64_t check, const FileStamp& stamp) const;
+};
+
+#endif // DETECTIONCACHE_H
@@ -6,21 +6,153 @@
 #include <map>
 #include <string>
 #include <stdexcept>
+#include <functional>
+#include <memory>
+#include "detectioncache.h"
+#include "trackstore.h"
+
+using ShapePositions = std::map<std::string, std::vector<std::pair<int, int>>>;
+using FrameConsumer = std::function<void(size_t frame_index, const ShapePositions& positions)>;
+
+// Blur and HoughCircles settings. They are part of the detection cache key,
+// so changing any of them re-detects every frame.
+struct DetectionParameters {
+    int blur_kernel = 9;
+    double blur_sigma = 2.0;
+    double dp = 1.2;
+    double min_distance = 30.0;
+    double canny_threshold = 50.0;
+    double accumulator_threshold = 30.0;
+    int min_radius = 15;
+    int max_radius = 50;
+};
+
+struct TrackingOptions {
+    // Search only a padded window around each track's predicted position and
+    // fall back to the whole frame when a track is not found there.
+    bool enabled = false;
+    // Detections per track fitted to predict the next position: 1 keeps the
+    // last position, 2 extrapolates velocity, 3 also acceleration.
+    size_t history = 3;
+    // Pixels searched on each side of a prediction; must cover the largest
+    // radius plus the expected prediction error.
+    int padding = 80;
+    // Frames a track may go undetected before it is dropped.
+    size_t max_missed = 2;
+    // Full-frame search every n frames so new objects are picked up; 0 only
+    // searches the full frame when there are no tracks or one is lost.
+    size_t full_search_interval = 0;
+};
+
+struct PipelineOptions {
+    // Workers per stage; 0 picks a default from the hardware thread count.
+    size_t decode_workers = 0;
+    size_t preprocess_workers = 0;
+    size_t detect_workers = 0;
+    // Frames buffered between two stages.
+    size_t queue_capacity = 8;
+    // Tracking needs each frame's predecessor, so it detects on one worker
+    // in frame order; decoding and preprocessing stay parallel.
+    TrackingOptions tracking;
+};
+
+struct VideoOptions {
+    // Only every `frame_stride`-th frame of the range is decoded and detected.
+    size_t frame_stride = 1;
+    // Frames with timestamps in [start_seconds, end_seconds); a negative end
+    // runs to the end of the video.
+    double start_seconds = 0.0;
+    double end_seconds = -1.0;
+    PipelineOptions pipeline;
+};
 
 class DetectObject {
 public:
-    DetectObject();
+    explicit DetectObject(const DetectionParameters& parameters = DetectionParameters());
+
+    // Frames found in the cache skip decoding and detection; detectPipelined
+    // stores new results and saves the cache when it finishes.
+    void setCache(std::shared_ptr<DetectionCache> cache);
 
     static std::vector<std::vector<std::vector<float>>> transformData(const std::vector<std::vector<std::pair<int, int>>>& input_data);
 
-    std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> detect(const std::vector<std::string>& image_paths, const std::vector<std::string>& shape_types);
+    std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> detect(const std::vector<std::string>& image_paths, const std::vector<std::string>& shape_types, const PipelineOptions& options = PipelineOptions());
+
+    // Appends every frame's `shape` detections to `tracks`, with the frame's
+    // position in `image_paths` as its time, and finishes the store.
+    void detectTracks(const std::vector<std::string>& image_paths, const std::string& shape, TrackStore& tracks, const PipelineOptions& options = PipelineOptions());
+
+    // Same as detectTracks, timed by frame number within the video.
+    void detectVideoTracks(const std::string& video_path, const std::string& shape, TrackStore& tracks, const VideoOptions& options = VideoOptions());
+
+    // Decodes, preprocesses and detects on separate worker pools joined by
+    // bounded queues. `consumer` runs on the calling thread, once per frame,
+    // in the order of `image_paths`, as soon as that frame and every earlier
+    // one are done. The first exception from any stage or from the consumer
+    // stops the pipeline and is rethrown here.
+    void detectPipelined(const std::vector<std::string>& image_paths, const std::vector<std::string>& shape_types, const FrameConsumer& consumer, const PipelineOptions& options = PipelineOptions());
+
+    // Streams frames straight from a video file through the same pipeline.
+    // Decoding is sequential; frames land in a fixed set of recycled buffers,
+    // so memory use does not grow with the length of the video. `consumer`
+    // receives the frame number within the video.
+    void detectVideo(const std::string& video_path, const std::vector<std::string>& shape_types, const FrameConsumer& consumer, const VideoOptions& options = VideoOptions());
+
+    // Collects detectVideo's output in the same layout detect() returns.
+    std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> detectVideo(const std::string& video_path, const std::vector<std::string>& shape_types, const VideoOptions& options = VideoOptions());
+
+    // Preprocesses and detects one decoded BGR frame on the calling thread,
+    // without the pipeline or the cache.
+    ShapePositions detectFrame(const cv::Mat& image, const std::vector<std::string>& shape_types);
 
 private:
-    using DetectorFunction = std::vector<std::pair<int, int>> (DetectObject::*)(const std::string&);
+    // One in-flight frame. Slots are recycled once their frame is delivered,
+    // so the image and gray buffers keep their allocation from frame to frame.
+    struct Slot {
+        size_t sequence = 0;
+        size_t index = 0;
+        // Set when positions came from the detection cache; the frame is
+        // then neither decoded nor detected.
+        bool cached = false;
+        // Source file of a decoded frame whose result may be cached.
+        const std::string* image_path = nullptr;
+        FileStamp stamp;
+        cv::Mat image;
+        cv::Mat gray;
+        ShapePositions positions;
+    };
+
+    struct TrackPoint {
+        double sequence;
+        double x;
+        double y;
+    };
+
+    struct Track {
+        std::vector<TrackPoint> history;
+        size_t missed = 0;
+    };
+
+    struct TrackerState {
+        std::map<std::string, std::vector<Track>> tracks;
+        size_t frames_since_full_search = 0;
+    };
+
+    using DetectorFunction = void (DetectObject::*)(const cv::Mat&, std::vector<std::pair<int, int>>&);
     std::map<std::string, DetectorFunction> detectors;
+    DetectionParameters parameters;
+    std::shared_ptr<DetectionCache> cache;
 
-    std::map<std::string, std::vector<std::pair<int, int>>> detectShapesInImage(const std::string& image_path, const std::vector<std::string>& shape_types);
-    std::vector<std::pair<int, int>> detectCircles(const std::string& image_path);
+    static size_t resolveWorkers(size_t requested, size_t hardware_share);
+    void runPipeline(const std::vector<std::string>& shape_types, const FrameConsumer& consumer, const PipelineOptions& options, size_t decode_workers, const std::function<bool(Slot&)>& decode);
+    void detectShapes(Slot& slot, const std::vector<std::string>& shape_types);
+    void detectTracked(Slot& slot, const std::vector<std::string>& shape_types, const TrackingOptions& options, TrackerState& state);
+    static std::pair<double, double> predictPosition(const Track& track, double sequence);
+    void addUnique(std::vector<std::pair<int, int>>& positions, std::pair<int, int> position) const;
+    void updateTracks(std::vector<Track>& tracks, const std::vector<std::pair<int, int>>& positions, size_t sequence, const TrackingOptions& options, bool full) const;
+    uint64_t parametersHash(const TrackingOptions& tracking) const;
+    void preprocess(const cv::Mat& image, cv::Mat& gray) const;
+    void detectCircles(const cv::Mat& gray, std::vector<std::pair<int, int>>& circle_centers);
 };
 
 std::vector<std::string> getImagePaths(const std::string& folder_path);
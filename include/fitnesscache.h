@@ -0,0 +1,68 @@
+#ifndef FITNESSCACHE_H
+#define FITNESSCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "program.h"
+#include "kernel.h"
+
+struct FitnessKey {
+    uint64_t hash;
+    // Independent second hash; a lookup only hits when both match.
+    uint64_t check;
+};
+
+// Bounded, thread-safe map from canonical program + data set to score. Keys
+// are spread over independently locked shards; each shard evicts its oldest
+// entry once full.
+class FitnessCache {
+public:
+    explicit FitnessCache(size_t capacity, size_t shard_count = 16);
+
+    // A `series` layout is part of the identity: the same samples split or
+    // aggregated differently score differently.
+    static uint64_t datasetId(std::span<const double> x_values, std::span<const double> desired_output, const SeriesLayout* series = nullptr);
+
+    // `scratch` holds the canonical program so callers can reuse its storage.
+    static FitnessKey makeKey(const Program& program, uint64_t dataset_id, Program& scratch);
+
+    bool lookup(const FitnessKey& key, double& score);
+
+    void insert(const FitnessKey& key, double score);
+
+    void clear();
+
+    size_t getHits() const;
+
+    size_t getMisses() const;
+
+    size_t getSize() const;
+
+private:
+    struct Entry {
+        uint64_t check;
+        double score;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Entry> entries;
+        std::vector<uint64_t> insertion_order;
+        size_t oldest = 0;
+    };
+
+    size_t shard_capacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+
+    Shard& shardFor(uint64_t hash);
+};
+
+#endif // FITNESSCACHE_H
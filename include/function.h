@@ -4,9 +4,13 @@
 #include <vector>
 #include <string>
 #include <cmath>
-#include <regex>
 #include <stdexcept>
 #include <sstream>
+#include <memory>
+#include <cstdint>
+#include <span>
+#include "program.h"
+#include "kernel.h"
 
 class Function {
 public:
@@ -14,24 +18,69 @@ public:
 
     static Function createFromInstructions(const std::string& instruction_string);
 
+    // Instructions are the canonical spelling of each op.
+    static Function createFromProgram(const Program& program);
+
     std::vector<double> calculate(const std::vector<double>& x_values);
 
+    // Writes one value per input into a caller-provided buffer.
+    void calculate(std::span<const double> x_values, double* y_values) const;
+
+    // Fused calculate + evaluateSimilarity that never materializes the output.
+    double evaluateFitness(std::span<const double> x_values, std::span<const double> desired_output);
+
     double evaluateSimilarity(const std::vector<double>& calculated_values, const std::vector<double>& desired_output);
 
+    // Re-runs only the instructions after the deepest prefix state still valid
+    // since the last edit, storing states every `interval` instructions within
+    // `max_bytes`. With a `series` layout the inputs are concatenated series
+    // scored per series.
+    double evaluateFitnessIncremental(std::span<const double> x_values, std::span<const double> desired_output, uint64_t dataset_id, size_t interval, size_t max_bytes, const SeriesLayout* series = nullptr);
+
+    void clearPrefixStates();
+
+    size_t getPrefixStateBytes() const;
+
+    void addInstruction(size_t index, const std::string& new_instruction);
+
+    void removeInstruction(size_t index);
+
     void substituteInstruction(size_t index, const std::string& new_instruction);
 
+    // Replaces the numeric operand of instruction `index`; throws for ln, sin
+    // and cos, which take none.
+    void setOperand(size_t index, double operand);
+
     double getScore() const;
 
+    void setScore(double score);
+
     const std::string& getExpression() const;
 
     const std::vector<std::string>& getInstructions() const;
 
+    const Program& getProgram() const;
+
+    // Capacity for `op_count` ops and an expression of `expression_length`
+    // characters, so assigning a Function up to that size does not allocate.
+    void reserve(size_t op_count, size_t expression_length);
+
 private:
+    // y after the first op_count instructions of `program`, for every sample.
+    struct PrefixState {
+        size_t op_count;
+        std::shared_ptr<const std::vector<double>> values;
+    };
+
     std::vector<std::string> instructions;
+    Program program;
     std::string expression;
     double score;
+    std::vector<PrefixState> prefix_states;
+    uint64_t prefix_dataset_id = 0;
 
-    std::string formatInstruction(const std::string& instruction);
+    void compile();
+    void invalidatePrefixStates(size_t op_count);
     void updateExpression();
 };
 
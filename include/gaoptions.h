@@ -0,0 +1,92 @@
+#ifndef GAOPTIONS_H
+#define GAOPTIONS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "kernel.h"
+
+class FitnessCache;
+class MetricsRecorder;
+
+struct GeneticAlgorithmOptions {
+    // Print every candidate's expression and score after each evaluation.
+    bool log_candidates = false;
+    // Threads used for evaluation and mutation, including the caller; 0 uses
+    // every hardware thread. Results depend only on `seed`, not on this value,
+    // unless `fitness_cache` is shared (see below).
+    size_t thread_count = 0;
+    uint64_t seed = 1;
+    // Entries in the fitness cache; 0 disables it. Pass `fitness_cache` to
+    // share one cache between runs (entries are keyed by data set). A cached
+    // score belongs to the first equivalent program scored. Equivalent
+    // programs agree only in exact arithmetic: rounding can differ, and a
+    // folded constant that overflows, or an intermediate that becomes inf or
+    // NaN in one program but not the other, can change the score outright.
+    // Runs on the same data that share a cache concurrently therefore depend
+    // on which run scored a program first; give each run its own cache when
+    // that matters.
+    size_t cache_capacity = 0;
+    std::shared_ptr<FitnessCache> fitness_cache;
+    // Keep intermediate y vectors so a mutated child only re-runs the
+    // instructions from the mutated index onward. States are recorded every
+    // `prefix_state_interval` instructions; `prefix_state_bytes` caps their
+    // total size across the population (the interval widens to fit).
+    bool incremental_evaluation = false;
+    size_t prefix_state_interval = 1;
+    size_t prefix_state_bytes = size_t(256) << 20;
+    // Score every candidate against all of time_value/desired_output instead
+    // of only series 0, in one pass over the concatenated samples. The
+    // per-series RMSEs are combined by `series_aggregate`; Weighted takes one
+    // weight per series from `series_weights`.
+    bool fit_all_series = false;
+    SeriesAggregate series_aggregate = SeriesAggregate::Mean;
+    std::vector<double> series_weights;
+    // After selection, tune the numeric operands of the best `refine_count`
+    // survivors with up to `refine_iterations` Levenberg–Marquardt steps. A
+    // survivor only takes the tuned operands if its score improves.
+    size_t refine_count = 0;
+    size_t refine_iterations = 20;
+    // Score hot programs with native x86-64 code (Linux only; a no-op
+    // elsewhere). A program is compiled once it has been scored
+    // `jit_min_uses` times, i.e. survived that many generations, or on first
+    // use when the data set has at least `jit_min_samples` samples. Scores are
+    // identical to the interpreter's; `jit_verify` checks each compilation
+    // against it. Not used with incremental_evaluation.
+    bool jit = false;
+    size_t jit_min_uses = 3;
+    size_t jit_min_samples = size_t(1) << 20;
+    bool jit_verify = false;
+    // Score the previous survivors first and abandon each child as soon as
+    // its partial error proves it cannot reach the worst score selection
+    // keeps. Selection is unchanged; abandoned children carry an upper bound
+    // instead of their score and are not cached. Incremental and native
+    // evaluation always run in full.
+    bool racing = false;
+    // Per-generation timings, scores and counters plus phase spans are
+    // recorded here when set; export them with MetricsRecorder::save once
+    // the run is over. One recorder may be shared by several runs; each
+    // tags its generations with `metrics_run`, or with the recorder's next
+    // run id when it is negative. BatchFitter uses the job id and
+    // IslandModel the island index.
+    std::shared_ptr<MetricsRecorder> metrics;
+    int64_t metrics_run = -1;
+    // run() saves a checkpoint to `checkpoint_path` every
+    // `checkpoint_interval` generations and after the last one. With
+    // `resume` set it continues from that file when it exists. Given the
+    // same data and options the resumed run matches the interrupted one
+    // exactly only without a fitness cache: cache entries are not saved, and
+    // a cached score may come from an equivalent program that scores
+    // differently (see `fitness_cache`).
+    std::string checkpoint_path;
+    int checkpoint_interval = 0;
+    bool resume = false;
+    // Programs that take the first places of the initial population instead
+    // of random ones, e.g. GaCheckpoint::getBestPrograms of an earlier run or
+    // the survivors of a neighbouring track's fit.
+    std::vector<Program> warm_start;
+};
+
+#endif // GAOPTIONS_H
@@ -3,28 +3,132 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <span>
 #include "function.h"
+#include "batchevaluator.h"
+#include "gaoptions.h"
+#include "threadpool.h"
+#include "rng.h"
+#include "fitnesscache.h"
+#include "constantrefiner.h"
+#include "jit.h"
+#include "metrics.h"
+#include "checkpoint.h"
 
 class GeneticAlgorithm {
 public:
-    GeneticAlgorithm(const std::vector<std::vector<double>>& time_value, const std::vector<std::vector<double>>& desired_output, int population_size, int generations);
+    GeneticAlgorithm(const std::vector<std::vector<double>>& time_value, const std::vector<std::vector<double>>& desired_output, int population_size, int generations, const GeneticAlgorithmOptions& options = GeneticAlgorithmOptions());
 
-    void run();
+    // Reads the series in place instead of copying them; both must outlive
+    // the GeneticAlgorithm.
+    GeneticAlgorithm(std::span<const double> x_values, std::span<const double> desired_values, int population_size, int generations, const GeneticAlgorithmOptions& options = GeneticAlgorithmOptions());
+
+    // Runs every generation and returns the best function found.
+    Function run();
+
+    void initialize();
+
+    // State between two steps, the RNG's included.
+    GaCheckpoint checkpoint() const;
+
+    // Replaces initialize(): the next step() continues the checkpointed run.
+    // Throws std::invalid_argument when the checkpoint was taken on other
+    // data or with another population size, or when its programs and scores
+    // do not form such a population (an empty program included).
+    void restore(const GaCheckpoint& checkpoint);
+
+    // One generation: evaluate, keep the top half (optionally refining the
+    // best survivors' constants) and refill with mutated copies.
+    void step();
+
+    // Children produced by the last step are scored first.
+    Function getBestFunction();
+
+    // Best survivors of the last step, best first.
+    std::vector<Function> getTopIndividuals(size_t count) const;
+
+    // Migrants replace the most recently created children.
+    void immigrate(const std::vector<Function>& migrants);
+
+    // Best score seen by the last step's selection.
+    double getBestScore() const;
+
+    int getGeneration() const;
+
+    int getGenerations() const;
+
+    std::shared_ptr<FitnessCache> getFitnessCache() const;
+
+    // Candidate samples never evaluated because racing abandoned the
+    // candidate, summed over the whole run.
+    size_t getSkippedSamples() const;
 
 private:
     std::vector<std::vector<double>> time_value;
     std::vector<std::vector<double>> desired_output;
+    std::span<const double> x_values;
+    std::span<const double> desired_values;
+    std::vector<double> series_x;
+    std::vector<double> series_desired;
+    std::vector<size_t> series_offsets;
+    SeriesLayout series_layout;
     int population_size;
     int generations;
+    GeneticAlgorithmOptions options;
     std::vector<Function> population;
+    // Back buffer of the population: survivors are swapped into it and the
+    // two are exchanged every generation, so both keep their storage.
+    std::vector<Function> next_population;
+    std::vector<uint32_t> ranking;
+    // Storage every recycled child slot is grown to; only ever increases.
+    size_t slot_ops = 0;
+    size_t slot_expression = 0;
+    BatchEvaluator evaluator;
+    std::unique_ptr<ThreadPool> pool;
+    int current_generation = 0;
+    size_t survivor_count = 0;
+    double best_score = 0.0;
+    bool population_scored = false;
+    std::shared_ptr<FitnessCache> cache;
+    uint64_t dataset_id = 0;
+    std::vector<FitnessKey> cache_keys;
+    std::vector<uint32_t> cache_misses;
+    std::vector<uint32_t> unique_misses;
+    std::vector<uint32_t> candidate_indices;
+    std::unique_ptr<JitCache> jit_cache;
+    std::vector<uint32_t> native_indices;
+    std::vector<std::shared_ptr<const JitProgram>> native_code;
+    std::vector<uint32_t> interpreted_indices;
+    std::vector<uint8_t> raced_out;
+    std::vector<double> cutoff_scratch;
+    size_t skipped_samples = 0;
+    uint64_t metrics_run = 0;
+    Program canonical_scratch;
+    std::vector<uint64_t> metrics_hashes;
+    std::vector<double> metrics_scores;
 
+    void setUpEvaluation();
+    void concatenateSeries();
+    const SeriesLayout* series() const;
+    static bool rankBefore(const Function& a, const Function& b);
+    Rng streamRng(int generation, size_t index) const;
     void generateInitialPopulation();
-    std::string generateRandomInstructions();
+    std::string generateRandomInstructions(Rng& rng);
     void evaluatePopulation();
+    void startGenerationMetrics(GenerationMetrics& metrics) const;
+    void collectEvaluationMetrics(GenerationMetrics& metrics);
+    void evaluateRange(size_t begin, size_t end, double cutoff);
+    double selectionCutoff(size_t keep);
+    void evaluateWithCache(size_t begin, size_t end, double cutoff);
+    void scoreCandidates(const std::vector<uint32_t>& indices, double cutoff);
+    void scoreInterpreted(const std::vector<uint32_t>& indices, double cutoff);
+    void scoreWithJit(const std::vector<uint32_t>& indices, double cutoff);
     void selectBestIndividuals();
+    void refineSurvivors();
+    void refineCandidate(Function& candidate);
     void performMutation();
-    std::string generateRandomInstruction();
-    Function getBestFunction();
+    const std::string& generateRandomInstruction(Rng& rng);
 };
 
 #endif // GENETICALGO_H
@@ -0,0 +1,55 @@
+#ifndef ISLANDMODEL_H
+#define ISLANDMODEL_H
+
+#include <cstddef>
+#include <vector>
+#include "function.h"
+#include "gaoptions.h"
+
+struct IslandOptions {
+    size_t island_count = 4;
+    // Generations between migrations; 0 keeps the islands isolated.
+    int migration_interval = 5;
+    // Best survivors each island sends per migration.
+    size_t migrant_count = 2;
+    // Ring sends to the next island; Random picks any other island each time.
+    enum class Topology { Ring, Random };
+    Topology topology = Topology::Ring;
+    // The first time any island's best score reaches this, the elapsed time is
+    // recorded; with `stop_at_target` every island then stops.
+    double target_score = 1.0;
+    bool stop_at_target = false;
+    // Per-island settings. Island i uses seed `ga.seed + i`, and a
+    // `thread_count` of 0 means one thread per island.
+    GeneticAlgorithmOptions ga;
+};
+
+struct IslandResult {
+    Function best;
+    double best_score;
+    size_t best_island;
+    bool reached_target;
+    double seconds_to_target;
+    int generations_to_target;
+    double seconds_total;
+};
+
+// Runs independent GeneticAlgorithm populations on their own threads and
+// periodically passes each island's top individuals to its neighbours over
+// lock-free queues. Migration is asynchronous, so unlike a single
+// GeneticAlgorithm the result can vary between runs with the same seed.
+class IslandModel {
+public:
+    IslandModel(const std::vector<std::vector<double>>& time_value, const std::vector<std::vector<double>>& desired_output, int population_size, int generations, const IslandOptions& options = IslandOptions());
+
+    IslandResult run();
+
+private:
+    std::vector<std::vector<double>> time_value;
+    std::vector<std::vector<double>> desired_output;
+    int population_size;
+    int generations;
+    IslandOptions options;
+};
+
+#endif // ISLANDMODEL_H
@@ -0,0 +1,98 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "kernel.h"
+#include "program.h"
+
+// A program compiled to native x86-64 code (Linux only). Every run of
+// arithmetic ops (+ - * / and constants) becomes one straight-line loop that
+// keeps y in a register, two samples per SSE2 instruction; ln, sin, cos and
+// pow are left to the kernel's vectorized routines, applied to the whole
+// block in between. The output is therefore bit for bit what
+// evaluateProgram produces. Despite the narrower vectors it beats the kernel
+// on arithmetic runs, since y never leaves a register between ops, while
+// programs dominated by ln, sin and cos run at the kernel's speed (see the
+// program_score benchmark). The code lives in its own mapping, which is
+// writable while it is emitted and executable afterwards, never both.
+class JitProgram {
+public:
+    // Returns nullptr where native code is unsupported or cannot be mapped.
+    static std::unique_ptr<JitProgram> compile(const Program& program);
+
+    ~JitProgram();
+
+    JitProgram(const JitProgram&) = delete;
+    JitProgram& operator=(const JitProgram&) = delete;
+
+    void run(const double* x_values, double* y_values, size_t count) const;
+
+    // Same block-wise reduction as evaluateProgramScore, and the same result.
+    double evaluateScore(const double* x_values, const double* desired_output, size_t count, const SeriesLayout* series) const;
+
+    // Compares run() with the interpreter on every given input, treating
+    // any two NaNs as equal.
+    bool matchesInterpreter(std::span<const double> x_values) const;
+
+private:
+    using Entry = void (*)(const double* in, double* out, size_t even_count);
+
+    // Ops [first_op, first_op + op_count) run natively from `entry`, or one
+    // op through applyOp when `entry` is null.
+    struct Segment {
+        size_t first_op;
+        size_t op_count;
+        Entry entry;
+    };
+
+    Program program;
+    std::vector<Segment> segments;
+    void* code = nullptr;
+    size_t code_size = 0;
+
+    JitProgram() = default;
+};
+
+// Compiled programs keyed by program hash. A program is compiled once it
+// has been requested `min_uses` times, or on first use when the data set has
+// at least `min_samples` samples. With `verify` set every new compilation is
+// checked against the interpreter and rejected on any mismatch. When more
+// than `capacity` programs are tracked the table is cleared; code still held
+// by a caller stays valid.
+class JitCache {
+public:
+    JitCache(size_t min_uses, size_t min_samples, size_t capacity = 4096, bool verify = false);
+
+    // Counts one use of `program`; returns its code once it is hot, nullptr
+    // otherwise (the caller falls back to the interpreter).
+    std::shared_ptr<const JitProgram> acquire(const Program& program, std::span<const double> x_values);
+
+    size_t getCompiledCount() const;
+
+    size_t getMismatchCount() const;
+
+private:
+    struct Entry {
+        Program program;
+        size_t uses = 0;
+        bool rejected = false;
+        std::shared_ptr<const JitProgram> code;
+    };
+
+    size_t min_uses;
+    size_t min_samples;
+    size_t capacity;
+    bool verify;
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    size_t compiled_count = 0;
+    size_t mismatch_count = 0;
+};
+
+#endif // JIT_H
@@ -0,0 +1,67 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <cstddef>
+#include <span>
+#include "program.h"
+
+// Samples are processed in blocks of this size so the working set of a
+// program stays in L1 while every instruction is applied to the block.
+constexpr size_t kKernelBlockSize = 256;
+
+struct ErrorSums {
+    double squared = 0.0;
+    double absolute = 0.0;
+    size_t count = 0;
+};
+
+enum class SeriesAggregate { Mean, Max, Weighted };
+
+// Several series concatenated into one sample array: series s owns samples
+// [offsets[s], offsets[s + 1]). The score is 1 / (1 + aggregate of the
+// per-series RMSEs); Weighted uses one weight per series.
+struct SeriesLayout {
+    std::span<const size_t> offsets;
+    SeriesAggregate aggregate = SeriesAggregate::Mean;
+    std::span<const double> weights;
+
+    size_t getSeriesCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+};
+
+// Vectorized evaluation. ln, sin and cos use polynomial approximations:
+// ln is within 2 ulp of std::log for every positive input, sin and cos are
+// within 2 ulp of libm for |y| <= 1e6 and fall back to libm per lane beyond
+// that. Integral exponents |c| <= 4 use repeated multiplication, and negative
+// ones the reciprocal of the product: within 2 ulp of std::pow, 3 ulp for
+// c = -4, while |y|^|c| is a normal number. Other exponents use std::pow.
+// tests/kernel_test.cpp checks these bounds. Every sample gets the same
+// arithmetic regardless of its position, so results do not depend on block
+// boundaries or the instruction set in use.
+void applyOp(const Op& op, double* y_values, size_t count);
+
+// Applies one opcode to row_count rows of samples, each with its own operand.
+void applyOpRows(OpCode code, const double* operands, double* rows, size_t row_count, size_t row_stride, size_t count);
+
+void evaluateProgram(const Program& program, const double* x_values, double* y_values, size_t count);
+
+void accumulateError(const double* y_values, const double* desired_output, size_t count, ErrorSums& sums);
+
+// Evaluates the program block by block and reduces the error on the fly,
+// without materializing the full output.
+ErrorSums evaluateProgramError(const Program& program, const double* x_values, const double* desired_output, size_t count);
+
+double similarityScore(const ErrorSums& sums);
+
+// Like accumulateError for samples [first_sample, first_sample + count) of
+// the concatenation, adding each sample to its own series' sums.
+void accumulateSeriesError(const double* y_values, const double* desired_output, size_t first_sample, size_t count, const SeriesLayout& layout, ErrorSums* sums);
+
+double seriesSimilarityScore(const ErrorSums* sums, const SeriesLayout& layout);
+
+// The similarity score the batch evaluator would give one program, scored
+// per series when `series` is set.
+double evaluateProgramScore(const Program& program, const double* x_values, const double* desired_output, size_t count, const SeriesLayout* series);
+
+const char* kernelInstructionSet();
+
+#endif // KERNEL_H
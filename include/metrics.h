@@ -0,0 +1,172 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One GA generation. Counters of features a run does not use (cache, racing,
+// JIT) stay zero.
+struct GenerationMetrics {
+    // The GeneticAlgorithm that recorded it (GeneticAlgorithmOptions::metrics_run);
+    // runs that share a recorder, or a thread, are told apart by it.
+    uint64_t run = 0;
+    int generation = 0;
+    // Candidates scored, cache hits included.
+    size_t evaluations = 0;
+    double evaluate_seconds = 0.0;
+    double select_seconds = 0.0;
+    double refine_seconds = 0.0;
+    double mutate_seconds = 0.0;
+    double best_score = 0.0;
+    // Abandoned (raced out) candidates count with their upper bound.
+    double median_score = 0.0;
+    // Distinct programs over population size.
+    double diversity = 0.0;
+    size_t cache_hits = 0;
+    size_t cache_misses = 0;
+    size_t raced_out = 0;
+    size_t skipped_samples = 0;
+    size_t jit_compiled = 0;
+
+    double evaluationsPerSecond() const;
+};
+
+enum class MetricsFormat {
+    // One row per generation.
+    Csv,
+    // Generations plus per-thread span totals.
+    Json,
+    // Spans and per-generation counters for chrome://tracing or Perfetto.
+    ChromeTrace
+};
+
+// Collects timed spans and generation metrics from any number of threads.
+// Every thread appends to its own buffer without locking; only a thread's
+// first record takes a lock to register it. Span storage is preallocated, so
+// recording a span never allocates, and spans beyond a buffer's capacity are
+// counted and dropped. Generation records (one per generation) go to a
+// growing vector. Buffers are matched by thread id, which the system may
+// reuse once a thread exits, so a buffer can hold several runs. Formatting
+// reads all buffers, so it must not run while threads are still recording.
+class MetricsRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit MetricsRecorder(size_t spans_per_thread = size_t(1) << 16);
+
+    MetricsRecorder(const MetricsRecorder&) = delete;
+    MetricsRecorder& operator=(const MetricsRecorder&) = delete;
+
+    // `name` must outlive the recorder (a string literal).
+    void recordSpan(const char* name, Clock::time_point start, Clock::time_point end);
+
+    void recordGeneration(const GenerationMetrics& metrics);
+
+    // Distinct on every call, starting from 0.
+    uint64_t nextRunId();
+
+    // In recording order per thread, threads in registration order.
+    std::vector<GenerationMetrics> getGenerations() const;
+
+    size_t getDroppedSpans() const;
+
+    std::string format(MetricsFormat format) const;
+
+    // Throws std::runtime_error when the file cannot be written.
+    void save(const std::string& path, MetricsFormat format) const;
+
+private:
+    struct Span {
+        const char* name;
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+
+    struct GenerationRecord {
+        GenerationMetrics metrics;
+        Clock::time_point time;
+    };
+
+    struct ThreadBuffer {
+        std::thread::id thread;
+        std::vector<Span> spans;
+        size_t dropped = 0;
+        std::vector<GenerationRecord> generations;
+    };
+
+    uint64_t id;
+    size_t spans_per_thread;
+    Clock::time_point origin;
+    std::atomic<uint64_t> next_run{0};
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    ThreadBuffer& localBuffer();
+    std::string formatCsv() const;
+    std::string formatJson() const;
+    std::string formatChromeTrace() const;
+};
+
+// Records its own lifetime as a span; does nothing without a recorder.
+class ScopedSpan {
+public:
+    ScopedSpan(MetricsRecorder* recorder, const char* name) : recorder(recorder), name(name) {
+        if (recorder) {
+            start = MetricsRecorder::Clock::now();
+        }
+    }
+
+    ~ScopedSpan() {
+        if (recorder) {
+            recorder->recordSpan(name, start, MetricsRecorder::Clock::now());
+        }
+    }
+
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    MetricsRecorder* recorder;
+    const char* name;
+    MetricsRecorder::Clock::time_point start;
+};
+
+// Times consecutive phases on one thread; does nothing without a recorder.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(MetricsRecorder* recorder) : recorder(recorder) {
+        restart();
+    }
+
+    void restart() {
+        if (recorder) {
+            start = MetricsRecorder::Clock::now();
+        }
+    }
+
+    // Records the phase since the last lap or restart as span `name`, starts
+    // the next one and returns the phase's length in seconds.
+    double lap(const char* name) {
+        if (!recorder) {
+            return 0.0;
+        }
+        MetricsRecorder::Clock::time_point end = MetricsRecorder::Clock::now();
+        recorder->recordSpan(name, start, end);
+        double seconds = std::chrono::duration<double>(end - start).count();
+        start = end;
+        return seconds;
+    }
+
+private:
+    MetricsRecorder* recorder;
+    MetricsRecorder::Clock::time_point start;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,51 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class OpCode : std::uint8_t {
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Pow,
+    Ln,
+    Sin,
+    Cos,
+    Set
+};
+
+struct Op {
+    OpCode code;
+    double operand;
+};
+
+// Decoded form of every instruction after the leading "y = x".
+using Program = std::vector<Op>;
+
+// Parses "y = y <op> <number>" (op is one of + - * / ^), "y = ln(y)",
+// "y = sin(y)", "y = cos(y)" or "y = <number>", with optional whitespace
+// around every token. The canonical spelling ("y = y + 2") is written to
+// `normalized`, reusing its storage; it must not alias `text`. Anything else
+// throws std::invalid_argument naming the position where parsing failed.
+Op parseInstruction(std::string_view text, std::string& normalized);
+
+// Canonical spelling of `op`, with the shortest operand text that parses
+// back to the same double.
+std::string formatInstruction(const Op& op);
+
+// Folds trivially equivalent sequences so they compare equal: adjacent
+// additive (+a, -b) and multiplicative (*a, /b) constants are merged and
+// dropped when they cancel, "y = c" discards everything before it and
+// absorbs following arithmetic, and y ^ 1 disappears. The folded program is
+// equal in exact arithmetic only: rounding may differ, and so may overflow
+// to inf or NaN, e.g. "* 1e300, / 1e300" folds away but overflows y = 1e10.
+void canonicalizeProgram(const Program& program, Program& canonical);
+
+uint64_t hashProgram(const Program& program, uint64_t seed);
+
+#endif // PROGRAM_H
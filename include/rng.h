@@ -0,0 +1,23 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstddef>
+#include <cstdint>
+
+// xoshiro256** generator seeded from a (seed, stream) pair through splitmix64.
+// Work items draw from the stream named by their own index, so results do not
+// depend on which thread happens to run them.
+class Rng {
+public:
+    Rng(uint64_t seed, uint64_t stream);
+
+    uint64_t next();
+
+    // Uniform integer in [0, bound).
+    size_t uniform(size_t bound);
+
+private:
+    uint64_t state[4];
+};
+
+#endif // RNG_H
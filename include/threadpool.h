@@ -0,0 +1,97 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work-stealing pool. Every worker owns a deque, pops its own tasks LIFO and
+// steals FIFO from the other deques when it runs dry. A thread waiting in
+// parallelFor executes queued tasks instead of sleeping, so nested calls from
+// inside a task cannot deadlock.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t worker_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t getWorkerCount() const;
+
+    // Fire-and-forget task; runs inline when the pool has no workers. An
+    // exception it throws is caught and kept for takeSubmitError().
+    void submit(std::function<void()> task);
+
+    // Returns and clears the first exception thrown by a submitted task
+    // since the last call; null when there was none.
+    std::exception_ptr takeSubmitError();
+
+    // Calls body(begin, end) on chunks of at most `grain` indices covering
+    // [0, count) and returns once all of them finished. The first exception
+    // thrown by a chunk is rethrown here.
+    template <typename Body>
+    void parallelFor(size_t count, size_t grain, Body&& body) {
+        using BodyType = std::remove_reference_t<Body>;
+        Job job;
+        job.invoke = [](void* context, size_t begin, size_t end) {
+            (*static_cast<BodyType*>(context))(begin, end);
+        };
+        job.context = const_cast<void*>(static_cast<const void*>(&body));
+        run(job, count, grain);
+    }
+
+private:
+    struct Job {
+        void (*invoke)(void* context, size_t begin, size_t end) = nullptr;
+        void* context = nullptr;
+        std::atomic<size_t> remaining{0};
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    struct Task {
+        Job* job;
+        size_t begin;
+        size_t end;
+        std::function<void()>* function;
+    };
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::vector<Task> ring;
+        size_t head = 0;
+        size_t size = 0;
+
+        void pushBack(const Task& task);
+        bool popBack(Task& task);
+        bool popFront(Task& task);
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> next_queue{0};
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::mutex submit_error_mutex;
+    std::exception_ptr submit_error;
+
+    void run(Job& job, size_t count, size_t grain);
+    void push(const Task& task);
+    bool tryRunOne();
+    void execute(Task& task);
+    void runSubmitted(std::function<void()>& function);
+    void workerLoop(size_t index);
+};
+
+#endif // THREADPOOL_H
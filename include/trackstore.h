@@ -0,0 +1,68 @@
+#ifndef TRACKSTORE_H
+#define TRACKSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Every track's samples in one structure-of-arrays block: after finish(),
+// track i owns rows [offsets[i], offsets[i + 1]) of the t, x and y columns,
+// which callers read as spans without copying.
+//
+// Frames are appended in time order. Each detection joins the open track
+// whose last sample is nearest, if within `max_distance` pixels; the rest
+// start new tracks. A track that misses more than `max_gap` consecutive
+// frames is closed.
+class TrackStore {
+public:
+    explicit TrackStore(double max_distance = 50.0, size_t max_gap = 2);
+
+    void appendFrame(double t, std::span<const std::pair<int, int>> positions);
+
+    // Groups the samples by track. Appending afterwards throws.
+    void finish();
+
+    void clear();
+
+    size_t getTrackCount() const;
+
+    size_t getSampleCount() const;
+
+    std::span<const double> getT(size_t track) const;
+
+    std::span<const double> getX(size_t track) const;
+
+    std::span<const double> getY(size_t track) const;
+
+private:
+    struct OpenTrack {
+        uint32_t id;
+        size_t last_frame;
+        double x;
+        double y;
+    };
+
+    double max_distance;
+    size_t max_gap;
+    // Samples in arrival order until finish() regroups them by track.
+    std::vector<double> t_values;
+    std::vector<double> x_values;
+    std::vector<double> y_values;
+    std::vector<uint32_t> track_ids;
+    std::vector<size_t> offsets;
+    std::vector<OpenTrack> open_tracks;
+    // Per-frame association scratch: (squared distance, open track, detection).
+    std::vector<std::tuple<double, size_t, size_t>> candidates;
+    std::vector<uint32_t> assigned;
+    std::vector<bool> track_taken;
+    size_t frame_count = 0;
+    size_t track_count = 0;
+    bool finished = false;
+
+    std::span<const double> column(const std::vector<double>& values, size_t track) const;
+};
+
+#endif // TRACKSTORE_H
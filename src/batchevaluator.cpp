@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include "batchevaluator.h"
+
+namespace {
+
+bool sameOpcodes(const Program& a, const Program& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t k = 0; k < a.size(); ++k) {
+        if (a[k].code != b[k].code) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+void BatchEvaluator::load(const std::vector<Function>& population) {
+    order.resize(population.size());
+    std::iota(order.begin(), order.end(), 0);
+    loadOrder(population);
+}
+
+void BatchEvaluator::load(const std::vector<Function>& population, const std::vector<uint32_t>& indices) {
+    order.assign(indices.begin(), indices.end());
+    loadOrder(population);
+}
+
+void BatchEvaluator::loadOrder(const std::vector<Function>& population) {
+    std::sort(order.begin(), order.end(), [&population](uint32_t a, uint32_t b) {
+        const Program& program_a = population[a].getProgram();
+        const Program& program_b = population[b].getProgram();
+        if (program_a.size() != program_b.size()) {
+            return program_a.size() < program_b.size();
+        }
+        for (size_t k = 0; k < program_a.size(); ++k) {
+            if (program_a[k].code != program_b[k].code) {
+                return program_a[k].code < program_b[k].code;
+            }
+        }
+        return a < b;
+    });
+
+    opcodes.clear();
+    operands.clear();
+    tiles.clear();
+    size_t start = 0;
+    while (start < order.size()) {
+        const Program& lead = population[order[start]].getProgram();
+        size_t end = start + 1;
+        while (end < order.size() && end - start < kTileSize && sameOpcodes(lead, population[order[end]].getProgram())) {
+            ++end;
+        }
+        tiles.push_back({start, end - start, opcodes.size(), lead.size(), operands.size()});
+        for (const Op& op : lead) {
+            opcodes.push_back(op.code);
+        }
+        for (size_t k = 0; k < lead.size(); ++k) {
+            for (size_t c = start; c < end; ++c) {
+                operands.push_back(population[order[c]].getProgram()[k].operand);
+            }
+        }
+        start = end;
+    }
+    scores.resize(population.size(), 0.0);
+    abandoned.resize(population.size(), 0);
+}
+
+void BatchEvaluator::evaluate(std::span<const double> x_values, std::span<const double> desired_output, ThreadPool* pool, const SeriesLayout* series, double cutoff) {
+    if (x_values.size() != desired_output.size()) {
+        throw std::invalid_argument("Input values and desired output must have the same length");
+    }
+    const size_t whole[2] = {0, x_values.size()};
+    const SeriesLayout layout = series ? *series : SeriesLayout{whole, SeriesAggregate::Mean, {}};
+    const size_t series_count = layout.getSeriesCount();
+    sums.assign(order.size() * series_count, ErrorSums());
+    this->cutoff = std::isnan(cutoff) ? -std::numeric_limits<double>::infinity() : cutoff;
+    per_series = series != nullptr;
+    abandoned_positions.assign(order.size(), 0);
+    tile_skipped.assign(tiles.size(), 0);
+    if (pool) {
+        pool->parallelFor(tiles.size(), 1, [&](size_t begin, size_t end) {
+            ScopedSpan span(metrics, "evaluate_tiles");
+            evaluateTiles(begin, end, x_values.data(), desired_output.data(), x_values.size(), layout);
+        });
+    } else {
+        ScopedSpan span(metrics, "evaluate_tiles");
+        evaluateTiles(0, tiles.size(), x_values.data(), desired_output.data(), x_values.size(), layout);
+    }
+    static thread_local std::vector<ErrorSums> scratch;
+    for (size_t c = 0; c < order.size(); ++c) {
+        abandoned[order[c]] = abandoned_positions[c];
+        if (abandoned_positions[c]) {
+            scores[order[c]] = scoreBound(c, layout, scratch);
+        } else {
+            scores[order[c]] = series ? seriesSimilarityScore(&sums[c * series_count], layout) : similarityScore(sums[c]);
+        }
+    }
+}
+
+void BatchEvaluator::setMetrics(MetricsRecorder* recorder) {
+    metrics = recorder;
+}
+
+const std::vector<double>& BatchEvaluator::getScores() const {
+    return scores;
+}
+
+const std::vector<uint8_t>& BatchEvaluator::getAbandoned() const {
+    return abandoned;
+}
+
+size_t BatchEvaluator::getSkippedSamples() const {
+    return std::accumulate(tile_skipped.begin(), tile_skipped.end(), size_t(0));
+}
+
+// The squared error only grows as samples are added, so scoring the partial
+// sums as if they covered every sample of their series bounds the final
+// score from above.
+double BatchEvaluator::scoreBound(size_t position, const SeriesLayout& series, std::vector<ErrorSums>& scratch) const {
+    const size_t series_count = series.getSeriesCount();
+    scratch.assign(sums.begin() + position * series_count, sums.begin() + (position + 1) * series_count);
+    for (size_t s = 0; s < series_count; ++s) {
+        scratch[s].count = series.offsets[s + 1] - series.offsets[s];
+    }
+    return per_series ? seriesSimilarityScore(scratch.data(), series) : similarityScore(scratch[0]);
+}
+
+// Moves a candidate's order entry, sums and operand column together.
+void BatchEvaluator::swapCandidates(const Tile& tile, size_t a, size_t b, size_t series_count) {
+    const size_t first = tile.first_candidate;
+    std::swap(order[first + a], order[first + b]);
+    std::swap(abandoned_positions[first + a], abandoned_positions[first + b]);
+    std::swap_ranges(sums.begin() + (first + a) * series_count, sums.begin() + (first + a + 1) * series_count, sums.begin() + (first + b) * series_count);
+    for (size_t k = 0; k < tile.opcode_count; ++k) {
+        double* column = operands.data() + tile.first_operand + k * tile.candidate_count;
+        std::swap(column[a], column[b]);
+    }
+}
+
+void BatchEvaluator::evaluateTiles(size_t tile_begin, size_t tile_end, const double* x_values, const double* desired_output, size_t count, const SeriesLayout& series) {
+    const size_t series_count = series.getSeriesCount();
+    const bool racing = cutoff > -std::numeric_limits<double>::infinity();
+    double states[kTileSize * kKernelBlockSize];
+    // Live candidates occupy the first live[t] slots of each tile. Scratch
+    // is per thread so steady-state generations do not allocate.
+    static thread_local std::vector<size_t> live;
+    static thread_local std::vector<ErrorSums> scratch;
+    live.resize(tile_end - tile_begin);
+    for (size_t t = tile_begin; t < tile_end; ++t) {
+        live[t - tile_begin] = tiles[t].candidate_count;
+    }
+    size_t remaining = tile_end - tile_begin;
+    for (size_t start = 0; start < count && remaining > 0; start += kKernelBlockSize) {
+        const size_t length = std::min(kKernelBlockSize, count - start);
+        for (size_t t = tile_begin; t < tile_end; ++t) {
+            const Tile& tile = tiles[t];
+            size_t& tile_live = live[t - tile_begin];
+            if (tile_live == 0) {
+                continue;
+            }
+            for (size_t c = 0; c < tile_live; ++c) {
+                std::copy(x_values + start, x_values + start + length, states + c * kKernelBlockSize);
+            }
+            for (size_t k = 0; k < tile.opcode_count; ++k) {
+                const double* tile_operands = operands.data() + tile.first_operand + k * tile.candidate_count;
+                applyOpRows(opcodes[tile.first_opcode + k], tile_operands, states, tile_live, kKernelBlockSize, length);
+            }
+            for (size_t c = 0; c < tile_live; ++c) {
+                accumulateSeriesError(states + c * kKernelBlockSize, desired_output + start, start, length, series, &sums[(tile.first_candidate + c) * series_count]);
+            }
+            if (!racing || start + length == count) {
+                continue;
+            }
+            for (size_t c = 0; c < tile_live;) {
+                if (scoreBound(tile.first_candidate + c, series, scratch) < cutoff) {
+                    swapCandidates(tile, c, tile_live - 1, series_count);
+                    --tile_live;
+                    abandoned_positions[tile.first_candidate + tile_live] = 1;
+                    tile_skipped[t] += count - (start + length);
+                } else {
+                    ++c;
+                }
+            }
+            if (tile_live == 0) {
+                --remaining;
+            }
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include "batchfitter.h"
+#include "geneticalgo.h"
+#include "fitnesscache.h"
+
+BatchFitter::BatchFitter(int population_size, int generations, const GeneticAlgorithmOptions& options, ThreadPool* pool)
+    : population_size(population_size), generations(generations), options(options), pool(pool) {
+    if (!pool) {
+        size_t thread_count = options.thread_count != 0 ? options.thread_count : std::max(1u, std::thread::hardware_concurrency());
+        owned_pool = std::make_unique<ThreadPool>(thread_count - 1);
+        this->pool = owned_pool.get();
+    }
+    this->options.thread_count = 1;
+    // Keys include the data set, so only jobs on identical series share entries.
+    if (!this->options.fitness_cache && options.cache_capacity > 0) {
+        this->options.fitness_cache = std::make_shared<FitnessCache>(options.cache_capacity);
+    }
+}
+
+size_t BatchFitter::add(const std::vector<std::vector<double>>& time_value, const std::vector<std::vector<double>>& desired_output, int priority) {
+    if (time_value.empty() || desired_output.empty()) {
+        throw std::invalid_argument("BatchFitter::add needs at least one series.");
+    }
+    if (time_value.size() != desired_output.size()) {
+        throw std::invalid_argument("BatchFitter::add needs one desired output per series.");
+    }
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    Job& job = jobs.emplace_back();
+    job.owned_time = time_value;
+    job.owned_desired = desired_output;
+    job.time_value = job.owned_time[0];
+    job.desired_output = job.owned_desired[0];
+    job.sample_count = 0;
+    for (const std::vector<double>& series : time_value) {
+        job.sample_count += series.size();
+    }
+    job.id = jobs.size() - 1;
+    job.priority = priority;
+    return jobs.size() - 1;
+}
+
+size_t BatchFitter::add(std::span<const double> time_value, std::span<const double> desired_output, int priority, std::vector<Program> warm_start) {
+    if (time_value.size() != desired_output.size()) {
+        throw std::invalid_argument("BatchFitter::add needs one desired output per time value.");
+    }
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    Job& job = jobs.emplace_back();
+    job.time_value = time_value;
+    job.desired_output = desired_output;
+    job.sample_count = time_value.size();
+    job.id = jobs.size() - 1;
+    job.priority = priority;
+    job.warm_start = std::move(warm_start);
+    return jobs.size() - 1;
+}
+
+void BatchFitter::cancel(size_t job) {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    if (job < jobs.size()) {
+        jobs[job].cancelled.store(true, std::memory_order_relaxed);
+    }
+}
+
+void BatchFitter::cancelAll() {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    for (Job& job : jobs) {
+        job.cancelled.store(true, std::memory_order_relaxed);
+    }
+}
+
+std::vector<FitResult> BatchFitter::run() {
+    std::vector<size_t> order(jobs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        if (jobs[a].priority != jobs[b].priority) {
+            return jobs[a].priority > jobs[b].priority;
+        }
+        return jobs[a].sample_count < jobs[b].sample_count;
+    });
+
+    // Runners claim jobs from one shared cursor rather than pre-split chunks,
+    // so the start order follows `order` no matter which thread is free.
+    std::vector<FitResult> results(jobs.size());
+    std::atomic<size_t> next{0};
+    pool->parallelFor(pool->getWorkerCount() + 1, 1, [&](size_t, size_t) {
+        for (size_t claimed = next.fetch_add(1); claimed < order.size(); claimed = next.fetch_add(1)) {
+            results[order[claimed]] = fit(jobs[order[claimed]]);
+        }
+    });
+    // Jobs are not added or removed while they run, so only clearing them
+    // has to exclude cancel().
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    jobs.clear();
+    return results;
+}
+
+FitResult BatchFitter::fit(Job& job) {
+    FitResult result;
+    if (job.cancelled.load(std::memory_order_relaxed)) {
+        result.cancelled = true;
+        return result;
+    }
+    GeneticAlgorithmOptions job_options = options;
+    job_options.metrics_run = static_cast<int64_t>(job.id);
+    if (!job.warm_start.empty()) {
+        job_options.warm_start = job.warm_start;
+    }
+    // Jobs added from vectors pass every series; the others are read in place.
+    std::unique_ptr<GeneticAlgorithm> ga = job.owned_time.empty()
+        ? std::make_unique<GeneticAlgorithm>(job.time_value, job.desired_output, population_size, generations, job_options)
+        : std::make_unique<GeneticAlgorithm>(job.owned_time, job.owned_desired, population_size, generations, job_options);
+    ga->initialize();
+    while (ga->getGeneration() < generations) {
+        if (job.cancelled.load(std::memory_order_relaxed)) {
+            result.cancelled = true;
+            return result;
+        }
+        ga->step();
+    }
+    Function best = ga->getBestFunction();
+    result.summary = summarize(best, job.time_value, job.desired_output);
+    for (const Function& survivor : ga->getTopIndividuals(population_size)) {
+        result.best_programs.push_back(survivor.getProgram());
+    }
+    return result;
+}
+
+// Instructions are joined with commas, as Function::createFromInstructions
+// reads them.
+std::map<std::string, std::string> BatchFitter::summarize(Function& function, std::span<const double> time_value, std::span<const double> desired_output) {
+    std::string instructions;
+    for (const std::string& instruction : function.getInstructions()) {
+        if (!instructions.empty()) {
+            instructions += ',';
+        }
+        instructions += instruction;
+    }
+    return {
+        {"best_function_expression", function.getExpression()},
+        {"best_function_instructions", instructions},
+        {"score", std::to_string(function.evaluateFitness(time_value, desired_output))},
+        {"track_str_infor", function.getExpression()}
+    };
+}
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include "checkpoint.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'G', 'A', 'C', 'K', 'P', 'T', '1'};
+constexpr uint32_t kVersion = 1;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t seed;
+    uint64_t dataset_id;
+    int32_t population_size;
+    int32_t generation;
+    uint64_t survivor_count;
+    double best_score;
+    uint64_t skipped_samples;
+    uint64_t program_count;
+    uint64_t op_count;
+};
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Appends raw bytes to the file image while hashing them.
+class Writer {
+public:
+    std::vector<unsigned char> bytes;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    void write(const void* data, size_t size) {
+        hash = hashBytes(hash, data, size);
+        const unsigned char* begin = static_cast<const unsigned char*>(data);
+        bytes.insert(bytes.end(), begin, begin + size);
+    }
+};
+
+class Reader {
+public:
+    Reader(const std::vector<unsigned char>& bytes, const std::string& path) : bytes(bytes), path(path) {}
+
+    void read(void* data, size_t size) {
+        if (size > bytes.size() - offset) {
+            fail("truncated");
+        }
+        std::memcpy(data, bytes.data() + offset, size);
+        hash = hashBytes(hash, data, size);
+        offset += size;
+    }
+
+    uint64_t getHash() const {
+        return hash;
+    }
+
+    bool atEnd() const {
+        return offset == bytes.size();
+    }
+
+    size_t remaining() const {
+        return bytes.size() - offset;
+    }
+
+    [[noreturn]] void fail(const char* reason) const {
+        throw std::runtime_error("Invalid checkpoint " + path + ": " + reason);
+    }
+
+private:
+    const std::vector<unsigned char>& bytes;
+    const std::string& path;
+    size_t offset = 0;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+};
+
+} // namespace
+
+std::vector<Program> GaCheckpoint::getBestPrograms(size_t count) const {
+    count = std::min({count, survivor_count, programs.size()});
+    return std::vector<Program>(programs.begin(), programs.begin() + count);
+}
+
+void saveCheckpoint(const std::string& path, const GaCheckpoint& checkpoint) {
+    if (checkpoint.scores.size() != checkpoint.programs.size()) {
+        throw std::invalid_argument("Checkpoint needs one score per program");
+    }
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.seed = checkpoint.seed;
+    header.dataset_id = checkpoint.dataset_id;
+    header.population_size = checkpoint.population_size;
+    header.generation = checkpoint.generation;
+    header.survivor_count = checkpoint.survivor_count;
+    header.best_score = checkpoint.best_score;
+    header.skipped_samples = checkpoint.skipped_samples;
+    header.program_count = checkpoint.programs.size();
+    std::vector<uint32_t> lengths;
+    std::vector<uint8_t> codes;
+    std::vector<double> operands;
+    for (const Program& program : checkpoint.programs) {
+        lengths.push_back(static_cast<uint32_t>(program.size()));
+        for (const Op& op : program) {
+            codes.push_back(static_cast<uint8_t>(op.code));
+            operands.push_back(op.operand);
+        }
+    }
+    header.op_count = codes.size();
+
+    Writer writer;
+    writer.write(&header, sizeof(header));
+    writer.write(lengths.data(), lengths.size() * sizeof(uint32_t));
+    writer.write(checkpoint.scores.data(), checkpoint.scores.size() * sizeof(double));
+    writer.write(codes.data(), codes.size());
+    writer.write(operands.data(), operands.size() * sizeof(double));
+    const uint64_t checksum = writer.hash;
+    writer.write(&checksum, sizeof(checksum));
+
+    const std::string temporary = path + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not write the checkpoint: " + temporary);
+    }
+    bool written = std::fwrite(writer.bytes.data(), 1, writer.bytes.size(), file) == writer.bytes.size();
+    written = (std::fclose(file) == 0) && written;
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("Could not write the checkpoint: " + path);
+    }
+}
+
+GaCheckpoint loadCheckpoint(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("Could not read the checkpoint: " + path);
+    }
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[1 << 16];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + read);
+    }
+    const bool failed = std::ferror(file) != 0;
+    std::fclose(file);
+    if (failed) {
+        throw std::runtime_error("Could not read the checkpoint: " + path);
+    }
+
+    Reader reader(bytes, path);
+    FileHeader header;
+    reader.read(&header, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        reader.fail("not a checkpoint");
+    }
+    if (header.version != kVersion) {
+        reader.fail("unsupported version");
+    }
+    // Sizes are checked against the file before anything is allocated.
+    const uint64_t payload = header.program_count * (sizeof(uint32_t) + sizeof(double)) + header.op_count * (sizeof(uint8_t) + sizeof(double)) + sizeof(uint64_t);
+    if (header.program_count > reader.remaining() || header.op_count > reader.remaining() || payload != reader.remaining()) {
+        reader.fail("truncated");
+    }
+
+    GaCheckpoint checkpoint;
+    checkpoint.seed = header.seed;
+    checkpoint.dataset_id = header.dataset_id;
+    checkpoint.population_size = header.population_size;
+    checkpoint.generation = header.generation;
+    checkpoint.survivor_count = header.survivor_count;
+    checkpoint.best_score = header.best_score;
+    checkpoint.skipped_samples = header.skipped_samples;
+    std::vector<uint32_t> lengths(header.program_count);
+    std::vector<uint8_t> codes(header.op_count);
+    std::vector<double> operands(header.op_count);
+    checkpoint.scores.resize(header.program_count);
+    reader.read(lengths.data(), lengths.size() * sizeof(uint32_t));
+    reader.read(checkpoint.scores.data(), checkpoint.scores.size() * sizeof(double));
+    reader.read(codes.data(), codes.size());
+    reader.read(operands.data(), operands.size() * sizeof(double));
+    const uint64_t expected = reader.getHash();
+    uint64_t checksum;
+    reader.read(&checksum, sizeof(checksum));
+    if (checksum != expected || !reader.atEnd()) {
+        reader.fail("checksum mismatch");
+    }
+
+    size_t op = 0;
+    for (uint32_t length : lengths) {
+        if (length > codes.size() - op) {
+            reader.fail("program lengths exceed the op table");
+        }
+        // Mutation needs an instruction after "y = x" to replace.
+        if (length == 0) {
+            reader.fail("empty program");
+        }
+        Program& program = checkpoint.programs.emplace_back();
+        for (uint32_t k = 0; k < length; ++k, ++op) {
+            if (codes[op] > static_cast<uint8_t>(OpCode::Set)) {
+                reader.fail("unknown opcode");
+            }
+            program.push_back({static_cast<OpCode>(codes[op]), operands[op]});
+        }
+    }
+    if (op != codes.size() || checkpoint.survivor_count > checkpoint.programs.size()) {
+        reader.fail("inconsistent counts");
+    }
+    return checkpoint;
+}
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "constantrefiner.h"
+
+namespace {
+
+constexpr double kInitialDamping = 1e-3;
+constexpr double kMaxDamping = 1e12;
+// Relative SSE improvement below which the fit is considered converged.
+constexpr double kTolerance = 1e-12;
+
+bool hasOperand(OpCode code) {
+    return code != OpCode::Ln && code != OpCode::Sin && code != OpCode::Cos;
+}
+
+// Normal equations of the linearized least-squares problem: jtj = JᵀJ and
+// jtr = Jᵀr for residuals r = y - desired. Returns the SSE, or infinity when
+// any sample (or derivative) is not finite.
+class NormalEquations {
+public:
+    explicit NormalEquations(const Program& program) {
+        for (size_t k = 0; k < program.size(); ++k) {
+            parameter_of.push_back(hasOperand(program[k].code) ? parameters++ : SIZE_MAX);
+        }
+        jtj.resize(parameters * parameters);
+        jtr.resize(parameters);
+        gradient.resize(parameters);
+    }
+
+    size_t getParameterCount() const {
+        return parameters;
+    }
+
+    double accumulate(const Program& program, std::span<const double> x_values, std::span<const double> desired_output) {
+        std::fill(jtj.begin(), jtj.end(), 0.0);
+        std::fill(jtr.begin(), jtr.end(), 0.0);
+        double sse = 0.0;
+        for (size_t i = 0; i < x_values.size(); ++i) {
+            const double residual = forward(program, x_values[i]) - desired_output[i];
+            if (!std::isfinite(residual)) {
+                return std::numeric_limits<double>::infinity();
+            }
+            sse += residual * residual;
+            for (size_t a = 0; a < parameters; ++a) {
+                jtr[a] += gradient[a] * residual;
+                for (size_t b = 0; b <= a; ++b) {
+                    jtj[a * parameters + b] += gradient[a] * gradient[b];
+                }
+            }
+        }
+        for (size_t a = 0; a < parameters; ++a) {
+            for (size_t b = 0; b < a; ++b) {
+                jtj[b * parameters + a] = jtj[a * parameters + b];
+            }
+        }
+        return std::isfinite(sse) ? sse : std::numeric_limits<double>::infinity();
+    }
+
+    const std::vector<double>& getJtJ() const {
+        return jtj;
+    }
+
+    const std::vector<double>& getJtr() const {
+        return jtr;
+    }
+
+private:
+    std::vector<size_t> parameter_of;
+    size_t parameters = 0;
+    std::vector<double> jtj;
+    std::vector<double> jtr;
+    std::vector<double> gradient;
+
+    // y for one sample, leaving dy/d(operand) in `gradient`.
+    double forward(const Program& program, double x) {
+        std::fill(gradient.begin(), gradient.end(), 0.0);
+        double y = x;
+        for (size_t k = 0; k < program.size(); ++k) {
+            const double c = program[k].operand;
+            const size_t p = parameter_of[k];
+            switch (program[k].code) {
+                case OpCode::Add:
+                    y += c;
+                    gradient[p] += 1.0;
+                    break;
+                case OpCode::Sub:
+                    y -= c;
+                    gradient[p] -= 1.0;
+                    break;
+                case OpCode::Mul:
+                    scale(c);
+                    gradient[p] += y;
+                    y *= c;
+                    break;
+                case OpCode::Div:
+                    scale(1.0 / c);
+                    y /= c;
+                    gradient[p] -= y / c;
+                    break;
+                case OpCode::Pow: {
+                    const double value = std::pow(y, c);
+                    scale(c * std::pow(y, c - 1.0));
+                    // d(y^c)/dc is y^c ln y, only defined for positive y.
+                    gradient[p] += (y > 0) ? value * std::log(y) : 0.0;
+                    y = value;
+                    break;
+                }
+                case OpCode::Ln:
+                    scale(1.0 / y);
+                    y = (y > 0) ? std::log(y) : NAN;
+                    break;
+                case OpCode::Sin:
+                    scale(std::cos(y));
+                    y = std::sin(y);
+                    break;
+                case OpCode::Cos:
+                    scale(-std::sin(y));
+                    y = std::cos(y);
+                    break;
+                case OpCode::Set:
+                    std::fill(gradient.begin(), gradient.end(), 0.0);
+                    gradient[p] = 1.0;
+                    y = c;
+                    break;
+            }
+        }
+        for (double derivative : gradient) {
+            if (!std::isfinite(derivative)) {
+                return NAN;
+            }
+        }
+        return y;
+    }
+
+    void scale(double factor) {
+        for (double& derivative : gradient) {
+            derivative *= factor;
+        }
+    }
+};
+
+// Solves (jtj + damping * diag(jtj)) step = -jtr in place by Cholesky
+// decomposition. Returns false when the damped matrix is not positive definite.
+bool solveDamped(const std::vector<double>& jtj, const std::vector<double>& jtr, double damping, size_t n, std::vector<double>& matrix, std::vector<double>& step) {
+    matrix = jtj;
+    for (size_t a = 0; a < n; ++a) {
+        const double diagonal = jtj[a * n + a];
+        matrix[a * n + a] += damping * std::max(diagonal, 1e-12);
+    }
+    for (size_t a = 0; a < n; ++a) {
+        for (size_t b = 0; b <= a; ++b) {
+            double sum = matrix[a * n + b];
+            for (size_t k = 0; k < b; ++k) {
+                sum -= matrix[a * n + k] * matrix[b * n + k];
+            }
+            if (a == b) {
+                if (!(sum > 0.0)) {
+                    return false;
+                }
+                matrix[a * n + a] = std::sqrt(sum);
+            } else {
+                matrix[a * n + b] = sum / matrix[b * n + b];
+            }
+        }
+    }
+    step.resize(n);
+    for (size_t a = 0; a < n; ++a) {
+        double sum = -jtr[a];
+        for (size_t k = 0; k < a; ++k) {
+            sum -= matrix[a * n + k] * step[k];
+        }
+        step[a] = sum / matrix[a * n + a];
+    }
+    for (size_t a = n; a-- > 0;) {
+        double sum = step[a];
+        for (size_t k = a + 1; k < n; ++k) {
+            sum -= matrix[k * n + a] * step[k];
+        }
+        step[a] = sum / matrix[a * n + a];
+    }
+    return true;
+}
+
+} // namespace
+
+double refineConstants(Program& program, std::span<const double> x_values, std::span<const double> desired_output, size_t max_iterations) {
+    if (x_values.size() != desired_output.size()) {
+        throw std::invalid_argument("Input values and desired output must have the same length");
+    }
+    NormalEquations current(program);
+    double sse = current.accumulate(program, x_values, desired_output);
+    const size_t n = current.getParameterCount();
+    if (n == 0 || !std::isfinite(sse)) {
+        return sse;
+    }
+
+    NormalEquations trial_equations(program);
+    Program trial = program;
+    std::vector<double> matrix;
+    std::vector<double> step;
+    double damping = kInitialDamping;
+    size_t iteration = 0;
+    while (iteration < max_iterations && damping < kMaxDamping && sse > 0.0) {
+        if (!solveDamped(current.getJtJ(), current.getJtr(), damping, n, matrix, step)) {
+            damping *= 4.0;
+            continue;
+        }
+        size_t p = 0;
+        for (size_t k = 0; k < program.size(); ++k) {
+            trial[k].operand = hasOperand(program[k].code) ? program[k].operand + step[p++] : program[k].operand;
+        }
+        const double trial_sse = trial_equations.accumulate(trial, x_values, desired_output);
+        ++iteration;
+        if (trial_sse < sse) {
+            const double improvement = sse - trial_sse;
+            program = trial;
+            sse = trial_sse;
+            std::swap(current, trial_equations);
+            damping = std::max(damping / 3.0, 1e-12);
+            if (improvement <= kTolerance * sse) {
+                break;
+            }
+        } else {
+            damping *= 4.0;
+        }
+    }
+    return sse;
+}
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "detectioncache.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'G', 'A', 'D', 'E', 'T', 'C', '1'};
+constexpr uint32_t kVersion = 1;
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t hashKey(uint64_t seed, const std::string& image_path, const std::string& shape, uint64_t parameters_hash) {
+    uint64_t hash = hashBytes(seed, image_path.data(), image_path.size());
+    hash = hashBytes(hash ^ 0xff, shape.data(), shape.size());
+    return hashBytes(hash, &parameters_hash, sizeof(parameters_hash));
+}
+
+uint64_t primaryKey(const std::string& image_path, const std::string& shape, uint64_t parameters_hash) {
+    return hashKey(0xcbf29ce484222325ULL, image_path, shape, parameters_hash);
+}
+
+uint64_t checkKey(const std::string& image_path, const std::string& shape, uint64_t parameters_hash) {
+    return hashKey(0x9e3779b97f4a7c15ULL, image_path, shape, parameters_hash);
+}
+
+bool writeAll(FILE* file, const void* data, size_t size) {
+    return size == 0 || std::fwrite(data, 1, size, file) == size;
+}
+
+} // namespace
+
+DetectionCache::DetectionCache(const std::string& path) : path(path) {
+    map();
+}
+
+DetectionCache::~DetectionCache() {
+    unmap();
+}
+
+bool DetectionCache::stampFile(const std::string& image_path, FileStamp& stamp) {
+    struct stat info;
+    if (stat(image_path.c_str(), &info) != 0) {
+        return false;
+    }
+    stamp.size = static_cast<uint64_t>(info.st_size);
+    stamp.mtime_ns = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    return true;
+}
+
+bool DetectionCache::lookup(const std::string& image_path, const FileStamp& stamp, const std::string& shape, uint64_t parameters_hash, std::vector<std::pair<int, int>>& result) {
+    const uint64_t key = primaryKey(image_path, shape, parameters_hash);
+    const uint64_t check = checkKey(image_path, shape, parameters_hash);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pending.find(key);
+    if (it != pending.end()) {
+        const PendingEntry& entry = it->second;
+        if (entry.check == check && entry.stamp.size == stamp.size && entry.stamp.mtime_ns == stamp.mtime_ns) {
+            result = entry.positions;
+            ++hits;
+            return true;
+        }
+    } else if (const FileEntry* entry = matchMapped(key, check, stamp)) {
+        used[entry - entries] = 1;
+        result.clear();
+        for (uint64_t p = 0; p < entry->position_count; ++p) {
+            const FilePosition& position = positions[entry->first_position + p];
+            result.emplace_back(position.x, position.y);
+        }
+        ++hits;
+        return true;
+    }
+    ++misses;
+    return false;
+}
+
+bool DetectionCache::lookupMapped(const std::string& image_path, const FileStamp& stamp, const std::string& shape, uint64_t parameters_hash, std::span<const FilePosition>& result) {
+    const uint64_t key = primaryKey(image_path, shape, parameters_hash);
+    const uint64_t check = checkKey(image_path, shape, parameters_hash);
+    std::lock_guard<std::mutex> lock(mutex);
+    // A pending entry replaces the saved one.
+    if (pending.find(key) == pending.end()) {
+        if (const FileEntry* entry = matchMapped(key, check, stamp)) {
+            used[entry - entries] = 1;
+            result = std::span<const FilePosition>(positions + entry->first_position, entry->position_count);
+            ++hits;
+            return true;
+        }
+    }
+    ++misses;
+    return false;
+}
+
+void DetectionCache::insert(const std::string& image_path, const FileStamp& stamp, const std::string& shape, uint64_t parameters_hash, const std::vector<std::pair<int, int>>& result) {
+    const uint64_t key = primaryKey(image_path, shape, parameters_hash);
+    std::lock_guard<std::mutex> lock(mutex);
+    pending[key] = {checkKey(image_path, shape, parameters_hash), stamp, result};
+    dirty = true;
+}
+
+void DetectionCache::invalidate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    unmap();
+    pending.clear();
+    dirty = true;
+}
+
+void DetectionCache::save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!dirty) {
+        return;
+    }
+
+    // Merge the sorted mapped table with the sorted pending map; pending
+    // entries replace mapped ones with the same key, and mapped entries no
+    // lookup hit are dropped.
+    std::vector<FileEntry> merged_entries;
+    std::vector<FilePosition> merged_positions;
+    auto appendPending = [&](uint64_t key, const PendingEntry& entry) {
+        merged_entries.push_back({key, entry.check, entry.stamp.size, entry.stamp.mtime_ns, merged_positions.size(), entry.positions.size()});
+        for (const auto& position : entry.positions) {
+            merged_positions.push_back({position.first, position.second});
+        }
+    };
+    auto appendMapped = [&](size_t index) {
+        const FileEntry& entry = entries[index];
+        if (!used[index] || entry.first_position > mapped_position_count || entry.position_count > mapped_position_count - entry.first_position) {
+            return;
+        }
+        merged_entries.push_back(entry);
+        merged_entries.back().first_position = merged_positions.size();
+        merged_positions.insert(merged_positions.end(), positions + entry.first_position, positions + entry.first_position + entry.position_count);
+    };
+    size_t mapped = 0;
+    for (const auto& [key, entry] : pending) {
+        while (mapped < entry_count && entries[mapped].key < key) {
+            appendMapped(mapped++);
+        }
+        if (mapped < entry_count && entries[mapped].key == key) {
+            ++mapped;
+        }
+        appendPending(key, entry);
+    }
+    while (mapped < entry_count) {
+        appendMapped(mapped++);
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.reserved = 0;
+    header.entry_count = merged_entries.size();
+    header.position_count = merged_positions.size();
+
+    const std::string temporary = path + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not write the detection cache: " + temporary);
+    }
+    bool written = writeAll(file, &header, sizeof(header))
+        && writeAll(file, merged_entries.data(), merged_entries.size() * sizeof(FileEntry))
+        && writeAll(file, merged_positions.data(), merged_positions.size() * sizeof(FilePosition));
+    written = (std::fclose(file) == 0) && written;
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("Could not write the detection cache: " + path);
+    }
+
+    unmap();
+    pending.clear();
+    dirty = false;
+    map();
+    // Everything just written was looked up or inserted in this session.
+    std::fill(used.begin(), used.end(), 1);
+}
+
+size_t DetectionCache::getHits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+size_t DetectionCache::getMisses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
+
+void DetectionCache::map() {
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(FileHeader)) {
+        close(descriptor);
+        return;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (data == MAP_FAILED) {
+        return;
+    }
+
+    const FileHeader* header = static_cast<const FileHeader*>(data);
+    const size_t expected = sizeof(FileHeader) + header->entry_count * sizeof(FileEntry) + header->position_count * sizeof(FilePosition);
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion || header->entry_count > size || header->position_count > size || expected != size) {
+        munmap(data, size);
+        return;
+    }
+    mapping = data;
+    mapping_size = size;
+    entry_count = header->entry_count;
+    mapped_position_count = header->position_count;
+    entries = reinterpret_cast<const FileEntry*>(static_cast<const char*>(data) + sizeof(FileHeader));
+    positions = reinterpret_cast<const FilePosition*>(entries + entry_count);
+    used.assign(entry_count, 0);
+}
+
+void DetectionCache::unmap() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = nullptr;
+    mapping_size = 0;
+    entries = nullptr;
+    positions = nullptr;
+    entry_count = 0;
+    mapped_position_count = 0;
+    used.clear();
+}
+
+const DetectionCache::FileEntry* DetectionCache::findMapped(uint64_t key) const {
+    const FileEntry* end = entries + entry_count;
+    const FileEntry* it = std::lower_bound(entries, end, key, [](const FileEntry& entry, uint64_t value) {
+        return entry.key < value;
+    });
+    return (it != end && it->key == key) ? it : nullptr;
+}
+
+// Only entries whose positions lie inside the mapped array match.
+const DetectionCache::FileEntry* DetectionCache::matchMapped(uint64_t key, uint64_t check, const FileStamp& stamp) const {
+    const FileEntry* entry = findMapped(key);
+    if (!entry) {
+        return nullptr;
+    }
+    bool in_bounds = entry->first_position <= mapped_position_count && entry->position_count <= mapped_position_count - entry->first_position;
+    if (in_bounds && entry->check == check && entry->file_size == stamp.size && entry->mtime_ns == stamp.mtime_ns) {
+        return entry;
+    }
+    return nullptr;
+}
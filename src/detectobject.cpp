@@ -5,80 +5,479 @@
 #include <string>
 #include <algorithm>
 #include <filesystem>
-#include <numeric>
 #include <cmath>
-#include <tuple>
 #include <stdexcept>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <memory>
+#include "boundedqueue.h"
+#include "detectobject.h"
 
 namespace fs = std::filesystem;
 
-class DetectObject {
-public:
-    DetectObject() {
-        detectors["circle"] = &DetectObject::detectCircles;
-    }
+DetectObject::DetectObject(const DetectionParameters& parameters) : parameters(parameters) {
+    detectors["circle"] = &DetectObject::detectCircles;
+}
 
-    static std::vector<std::vector<std::vector<float>>> transformData(const std::vector<std::vector<std::pair<int, int>>>& input_data) {
-        std::vector<std::vector<std::vector<float>>> result;
-        for (const auto& sublist : input_data) {
-            std::vector<float> x_values;
-            std::vector<float> y_values;
-            for (const auto& t : sublist) {
-                x_values.push_back(static_cast<float>(t.first));
-                y_values.push_back(static_cast<float>(t.second));
-            }
-            result.push_back({x_values, y_values});
+void DetectObject::setCache(std::shared_ptr<DetectionCache> cache) {
+    this->cache = std::move(cache);
+}
+
+std::vector<std::vector<std::vector<float>>> DetectObject::transformData(const std::vector<std::vector<std::pair<int, int>>>& input_data) {
+    std::vector<std::vector<std::vector<float>>> result;
+    for (const auto& sublist : input_data) {
+        std::vector<float> x_values;
+        std::vector<float> y_values;
+        for (const auto& t : sublist) {
+            x_values.push_back(static_cast<float>(t.first));
+            y_values.push_back(static_cast<float>(t.second));
         }
-        return result;
+        result.push_back({x_values, y_values});
     }
+    return result;
+}
+
+std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> DetectObject::detect(const std::vector<std::string>& image_paths, const std::vector<std::string>& shape_types, const PipelineOptions& options) {
+    std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> results;
+    for (const auto& shape : shape_types) {
+        results[shape].reserve(image_paths.size());
+    }
+    detectPipelined(image_paths, shape_types, [&](size_t, const ShapePositions& positions) {
+        for (const auto& shape : shape_types) {
+            results[shape].push_back(positions.at(shape));
+        }
+    }, options);
+    return results;
+}
+
+void DetectObject::detectTracks(const std::vector<std::string>& image_paths, const std::string& shape, TrackStore& tracks, const PipelineOptions& options) {
+    detectPipelined(image_paths, {shape}, [&](size_t frame_index, const ShapePositions& positions) {
+        tracks.appendFrame(static_cast<double>(frame_index), positions.at(shape));
+    }, options);
+    tracks.finish();
+}
 
-    std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> detect(const std::vector<std::string>& image_paths, const std::vector<std::string>& shape_types) {
-        std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> results;
-        for (const auto& path : image_paths) {
-            auto image_results = detectShapesInImage(path, shape_types);
+void DetectObject::detectVideoTracks(const std::string& video_path, const std::string& shape, TrackStore& tracks, const VideoOptions& options) {
+    detectVideo(video_path, {shape}, [&](size_t frame_index, const ShapePositions& positions) {
+        tracks.appendFrame(static_cast<double>(frame_index), positions.at(shape));
+    }, options);
+    tracks.finish();
+}
+
+void DetectObject::detectPipelined(const std::vector<std::string>& image_paths, const std::vector<std::string>& shape_types, const FrameConsumer& consumer, const PipelineOptions& options) {
+    std::atomic<size_t> next_path{0};
+    const uint64_t parameters_hash = parametersHash(options.tracking);
+    runPipeline(shape_types, consumer, options, resolveWorkers(options.decode_workers, 4), [&](Slot& slot) {
+        size_t index = next_path.fetch_add(1);
+        if (index >= image_paths.size()) {
+            return false;
+        }
+        slot.sequence = index;
+        slot.index = index;
+        slot.cached = false;
+        slot.image_path = nullptr;
+        if (cache && DetectionCache::stampFile(image_paths[index], slot.stamp)) {
+            slot.cached = true;
             for (const auto& shape : shape_types) {
-                results[shape].push_back(image_results[shape]);
+                slot.cached = slot.cached && cache->lookup(image_paths[index], slot.stamp, shape, parameters_hash, slot.positions[shape]);
+            }
+            if (slot.cached) {
+                return true;
             }
+            slot.image_path = &image_paths[index];
         }
-        return results;
+        slot.image = cv::imread(image_paths[index]);
+        if (slot.image.empty()) {
+            printf("Could not open or find the image: %s\n", image_paths[index].c_str());
+            slot.image_path = nullptr;
+        }
+        return true;
+    });
+    if (cache) {
+        cache->save();
     }
+}
 
-private:
-    using DetectorFunction = std::vector<std::pair<int, int>> (DetectObject::*)(const std::string&);
-    std::map<std::string, DetectorFunction> detectors;
+void DetectObject::detectVideo(const std::string& video_path, const std::vector<std::string>& shape_types, const FrameConsumer& consumer, const VideoOptions& options) {
+    if (options.frame_stride == 0) {
+        throw std::invalid_argument("Video frame stride must be at least 1.");
+    }
+    cv::VideoCapture capture(video_path);
+    if (!capture.isOpened()) {
+        throw std::invalid_argument("Could not open the video: " + video_path);
+    }
+    if (options.start_seconds > 0.0) {
+        capture.set(cv::CAP_PROP_POS_MSEC, options.start_seconds * 1000.0);
+    }
 
-    std::map<std::string, std::vector<std::pair<int, int>>> detectShapesInImage(const std::string& image_path, const std::vector<std::string>& shape_types) {
-        std::map<std::string, std::vector<std::pair<int, int>>> results;
+    size_t sequence = 0;
+    size_t in_range = 0;
+    runPipeline(shape_types, consumer, options.pipeline, 1, [&](Slot& slot) {
+        // Skipped frames are only grabbed, never decoded into a buffer.
+        while (capture.grab()) {
+            double seconds = capture.get(cv::CAP_PROP_POS_MSEC) / 1000.0;
+            if (options.end_seconds >= 0.0 && seconds >= options.end_seconds) {
+                return false;
+            }
+            if (seconds < options.start_seconds || in_range++ % options.frame_stride != 0) {
+                continue;
+            }
+            slot.sequence = sequence++;
+            slot.index = static_cast<size_t>(capture.get(cv::CAP_PROP_POS_FRAMES)) - 1;
+            slot.cached = false;
+            slot.image_path = nullptr;
+            capture.retrieve(slot.image);
+            return true;
+        }
+        return false;
+    });
+}
+
+std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> DetectObject::detectVideo(const std::string& video_path, const std::vector<std::string>& shape_types, const VideoOptions& options) {
+    std::map<std::string, std::vector<std::vector<std::pair<int, int>>>> results;
+    detectVideo(video_path, shape_types, [&](size_t, const ShapePositions& positions) {
         for (const auto& shape : shape_types) {
-            if (detectors.find(shape) == detectors.end()) {
-                throw std::invalid_argument("Unsupported shape type: " + shape);
+            results[shape].push_back(positions.at(shape));
+        }
+    }, options);
+    return results;
+}
+
+ShapePositions DetectObject::detectFrame(const cv::Mat& image, const std::vector<std::string>& shape_types) {
+    Slot slot;
+    slot.image = image;
+    preprocess(slot.image, slot.gray);
+    detectShapes(slot, shape_types);
+    return slot.positions;
+}
+
+size_t DetectObject::resolveWorkers(size_t requested, size_t hardware_share) {
+    if (requested != 0) {
+        return requested;
+    }
+    return std::max<size_t>(1, std::max(1u, std::thread::hardware_concurrency()) / hardware_share);
+}
+
+// `decode` fills the slot's sequence (0, 1, 2, ... across all calls),
+// frame index and image, and returns false once the input is exhausted.
+// It is called concurrently when `decode_workers` > 1.
+void DetectObject::runPipeline(const std::vector<std::string>& shape_types, const FrameConsumer& consumer, const PipelineOptions& options, size_t decode_workers, const std::function<bool(Slot&)>& decode) {
+    for (const auto& shape : shape_types) {
+        if (detectors.find(shape) == detectors.end()) {
+            throw std::invalid_argument("Unsupported shape type: " + shape);
+        }
+    }
+
+    const size_t preprocess_workers = resolveWorkers(options.preprocess_workers, 4);
+    const size_t detect_workers = options.tracking.enabled ? 1 : resolveWorkers(options.detect_workers, 2);
+    const size_t capacity = std::max<size_t>(1, options.queue_capacity);
+    const uint64_t parameters_hash = parametersHash(options.tracking);
+    std::vector<Slot> slots(2 * capacity + decode_workers + preprocess_workers + detect_workers);
+
+    BoundedQueue<size_t> free_slots(slots.size());
+    BoundedQueue<size_t> decoded(capacity);
+    BoundedQueue<size_t> preprocessed(capacity);
+    BoundedQueue<size_t> detected(slots.size());
+    for (size_t i = 0; i < slots.size(); ++i) {
+        free_slots.push(i);
+    }
+    std::atomic<size_t> decoders_left{decode_workers};
+    std::atomic<size_t> preprocessors_left{preprocess_workers};
+    std::atomic<size_t> detectors_left{detect_workers};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    auto fail = [&] {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
             }
-            results[shape] = (this->*detectors[shape])(image_path);
         }
-        return results;
+        free_slots.close();
+        decoded.close();
+        preprocessed.close();
+        detected.close();
+    };
+    // The last worker of a stage closes its output so the next stage drains and exits.
+    auto stage = [&](std::atomic<size_t>& left, BoundedQueue<size_t>& output, auto body) {
+        try {
+            body();
+        } catch (...) {
+            fail();
+        }
+        if (left.fetch_sub(1) == 1) {
+            output.close();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < decode_workers; ++i) {
+        workers.emplace_back([&] {
+            stage(decoders_left, decoded, [&] {
+                size_t slot;
+                while (free_slots.pop(slot) && decode(slots[slot])) {
+                    if (!decoded.push(slot)) {
+                        return;
+                    }
+                }
+            });
+        });
+    }
+    for (size_t i = 0; i < preprocess_workers; ++i) {
+        workers.emplace_back([&] {
+            stage(preprocessors_left, preprocessed, [&] {
+                size_t slot;
+                while (decoded.pop(slot)) {
+                    Slot& frame = slots[slot];
+                    if (frame.image.empty() || frame.cached) {
+                        frame.gray.release();
+                    } else {
+                        preprocess(frame.image, frame.gray);
+                    }
+                    if (!preprocessed.push(slot)) {
+                        return;
+                    }
+                }
+            });
+        });
+    }
+    if (options.tracking.enabled) {
+        workers.emplace_back([&] {
+            stage(detectors_left, detected, [&] {
+                TrackerState tracker;
+                std::map<size_t, size_t> waiting;
+                size_t next_sequence = 0;
+                size_t slot;
+                while (preprocessed.pop(slot)) {
+                    waiting.emplace(slots[slot].sequence, slot);
+                    for (auto it = waiting.find(next_sequence); it != waiting.end(); it = waiting.find(next_sequence)) {
+                        detectTracked(slots[it->second], shape_types, options.tracking, tracker);
+                        if (!detected.push(it->second)) {
+                            return;
+                        }
+                        waiting.erase(it);
+                        ++next_sequence;
+                    }
+                }
+            });
+        });
+    }
+    for (size_t i = 0; i < detect_workers && !options.tracking.enabled; ++i) {
+        workers.emplace_back([&] {
+            stage(detectors_left, detected, [&] {
+                size_t slot;
+                while (preprocessed.pop(slot)) {
+                    if (!slots[slot].cached) {
+                        detectShapes(slots[slot], shape_types);
+                    }
+                    if (!detected.push(slot)) {
+                        return;
+                    }
+                }
+            });
+        });
     }
 
-    std::vector<std::pair<int, int>> detectCircles(const std::string& image_path) {
-        cv::Mat image = cv::imread(image_path);
-        if (image.empty()) {
-            printf("Could not open or find the image: %s\n", image_path.c_str());
-            return {};
+    // Frames finish out of order; hold the early ones until their turn.
+    // A slot only returns to the decoders after delivery, which also
+    // bounds how far the pipeline can run ahead of a stalled frame.
+    std::map<size_t, size_t> waiting;
+    size_t next_sequence = 0;
+    size_t slot;
+    try {
+        while (detected.pop(slot)) {
+            waiting.emplace(slots[slot].sequence, slot);
+            for (auto it = waiting.find(next_sequence); it != waiting.end(); it = waiting.find(next_sequence)) {
+                Slot& ready = slots[it->second];
+                if (cache && ready.image_path) {
+                    for (const auto& shape : shape_types) {
+                        cache->insert(*ready.image_path, ready.stamp, shape, parameters_hash, ready.positions.at(shape));
+                    }
+                }
+                consumer(ready.index, ready.positions);
+                free_slots.push(it->second);
+                waiting.erase(it);
+                ++next_sequence;
+            }
         }
+    } catch (...) {
+        fail();
+    }
+    free_slots.close();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
 
-        cv::Mat gray;
-        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-        cv::GaussianBlur(gray, gray, cv::Size(9, 9), 2);
+// Detectors take the blurred grayscale frame; empty frames detect nothing.
+void DetectObject::detectShapes(Slot& slot, const std::vector<std::string>& shape_types) {
+    for (const auto& shape : shape_types) {
+        std::vector<std::pair<int, int>>& positions = slot.positions[shape];
+        positions.clear();
+        if (!slot.gray.empty()) {
+            (this->*detectors.at(shape))(slot.gray, positions);
+        }
+    }
+}
+
+void DetectObject::detectTracked(Slot& slot, const std::vector<std::string>& shape_types, const TrackingOptions& options, TrackerState& state) {
+    bool periodic = options.full_search_interval != 0 && state.frames_since_full_search + 1 >= options.full_search_interval;
+    bool searched_full = false;
+    for (const auto& shape : shape_types) {
+        std::vector<std::pair<int, int>>& positions = slot.positions[shape];
+        std::vector<Track>& tracks = state.tracks[shape];
+        if (slot.cached) {
+            updateTracks(tracks, positions, slot.sequence, options, true);
+            continue;
+        }
+        positions.clear();
+        if (slot.gray.empty()) {
+            updateTracks(tracks, positions, slot.sequence, options, false);
+            continue;
+        }
+
+        const DetectorFunction detector = detectors.at(shape);
+        const cv::Rect frame(0, 0, slot.gray.cols, slot.gray.rows);
+        bool full = periodic || tracks.empty();
+        thread_local std::vector<std::pair<int, int>> window_positions;
+        for (size_t t = 0; t < tracks.size() && !full; ++t) {
+            std::pair<double, double> predicted = predictPosition(tracks[t], slot.sequence);
+            cv::Rect window = cv::Rect(static_cast<int>(std::lround(predicted.first)) - options.padding, static_cast<int>(std::lround(predicted.second)) - options.padding, 2 * options.padding + 1, 2 * options.padding + 1) & frame;
+            window_positions.clear();
+            if (!window.empty()) {
+                (this->*detector)(slot.gray(window), window_positions);
+            }
+            if (window_positions.empty()) {
+                full = true;
+            }
+            for (const auto& position : window_positions) {
+                addUnique(positions, {position.first + window.x, position.second + window.y});
+            }
+        }
+        if (full) {
+            positions.clear();
+            (this->*detector)(slot.gray, positions);
+            searched_full = true;
+        }
+        updateTracks(tracks, positions, slot.sequence, options, full);
+    }
+    state.frames_since_full_search = searched_full ? 0 : state.frames_since_full_search + 1;
+}
+
+// Lagrange extrapolation through the track's recent detections.
+std::pair<double, double> DetectObject::predictPosition(const Track& track, double sequence) {
+    const std::vector<TrackPoint>& points = track.history;
+    double x = 0.0;
+    double y = 0.0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        double weight = 1.0;
+        for (size_t j = 0; j < points.size(); ++j) {
+            if (j != i) {
+                weight *= (sequence - points[j].sequence) / (points[i].sequence - points[j].sequence);
+            }
+        }
+        x += weight * points[i].x;
+        y += weight * points[i].y;
+    }
+    return {x, y};
+}
+
+// Detections closer than the smallest radius HoughCircles looks for are
+// the same object seen from two overlapping windows.
+void DetectObject::addUnique(std::vector<std::pair<int, int>>& positions, std::pair<int, int> position) const {
+    for (const auto& existing : positions) {
+        int dx = existing.first - position.first;
+        int dy = existing.second - position.second;
+        if (dx * dx + dy * dy < parameters.min_radius * parameters.min_radius) {
+            return;
+        }
+    }
+    positions.push_back(position);
+}
 
-        std::vector<cv::Vec3f> circles;
-        cv::HoughCircles(gray, circles, cv::HOUGH_GRADIENT, 1.2, 30, 50, 30, 15, 50);
+// Each track claims the nearest unclaimed detection within its window.
+// Only full-frame searches start new tracks.
+void DetectObject::updateTracks(std::vector<Track>& tracks, const std::vector<std::pair<int, int>>& positions, size_t sequence, const TrackingOptions& options, bool full) const {
+    std::vector<bool> claimed(positions.size(), false);
+    for (Track& track : tracks) {
+        std::pair<double, double> predicted = predictPosition(track, sequence);
+        size_t best = positions.size();
+        double best_distance = 0.0;
+        for (size_t p = 0; p < positions.size(); ++p) {
+            double dx = positions[p].first - predicted.first;
+            double dy = positions[p].second - predicted.second;
+            if (claimed[p] || std::max(std::abs(dx), std::abs(dy)) > options.padding) {
+                continue;
+            }
+            double distance = dx * dx + dy * dy;
+            if (best == positions.size() || distance < best_distance) {
+                best = p;
+                best_distance = distance;
+            }
+        }
+        if (best == positions.size()) {
+            ++track.missed;
+            continue;
+        }
+        claimed[best] = true;
+        track.missed = 0;
+        track.history.push_back({static_cast<double>(sequence), static_cast<double>(positions[best].first), static_cast<double>(positions[best].second)});
+        if (track.history.size() > std::max<size_t>(1, options.history)) {
+            track.history.erase(track.history.begin());
+        }
+    }
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(), [&options](const Track& track) {
+        return track.missed > options.max_missed;
+    }), tracks.end());
+    for (size_t p = 0; p < positions.size() && full; ++p) {
+        if (!claimed[p]) {
+            Track track;
+            track.history.push_back({static_cast<double>(sequence), static_cast<double>(positions[p].first), static_cast<double>(positions[p].second)});
+            tracks.push_back(track);
+        }
+    }
+}
 
-        std::vector<std::pair<int, int>> circle_centers;
-        for (const auto& circle : circles) {
-            circle_centers.emplace_back(static_cast<int>(circle[0]), static_cast<int>(circle[1]));
+// Tracked results can differ slightly from full-frame ones, so tracking
+// is part of the key too.
+uint64_t DetectObject::parametersHash(const TrackingOptions& tracking) const {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
         }
-        return circle_centers;
+    };
+    const double values[] = {double(parameters.blur_kernel), parameters.blur_sigma, parameters.dp, parameters.min_distance, parameters.canny_threshold, parameters.accumulator_threshold, double(parameters.min_radius), double(parameters.max_radius)};
+    mix(values, sizeof(values));
+    if (tracking.enabled) {
+        const double tracked[] = {double(tracking.history), double(tracking.padding), double(tracking.max_missed), double(tracking.full_search_interval)};
+        mix(tracked, sizeof(tracked));
     }
-};
+    return hash;
+}
+
+void DetectObject::preprocess(const cv::Mat& image, cv::Mat& gray) const {
+    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    cv::GaussianBlur(gray, gray, cv::Size(parameters.blur_kernel, parameters.blur_kernel), parameters.blur_sigma);
+}
+
+void DetectObject::detectCircles(const cv::Mat& gray, std::vector<std::pair<int, int>>& circle_centers) {
+    thread_local std::vector<cv::Vec3f> circles;
+    cv::HoughCircles(gray, circles, cv::HOUGH_GRADIENT, parameters.dp, parameters.min_distance, parameters.canny_threshold, parameters.accumulator_threshold, parameters.min_radius, parameters.max_radius);
+
+    for (const auto& circle : circles) {
+        circle_centers.emplace_back(static_cast<int>(circle[0]), static_cast<int>(circle[1]));
+    }
+}
 
 std::vector<std::string> getImagePaths(const std::string& folder_path) {
     if (!fs::exists(folder_path)) {
@@ -97,25 +496,3 @@ std::vector<std::string> getImagePaths(const std::string& folder_path) {
     std::sort(image_paths.begin(), image_paths.end());
     return image_paths;
 }
-
-int main() {
-    try {
-        std::string folder_path = "/Users/dong/Desktop/video/withballframes";
-        auto image_paths = getImagePaths(folder_path);
-
-        DetectObject detector;
-        auto positions_of_circles = detector.detect(image_paths, {"circle"});
-
-        // Print detected circle positions
-        for (const auto& frame : positions_of_circles["circle"]) {
-            for (const auto& position : frame) {
-                printf("(%d, %d) ", position.first, position.second);
-            }
-            printf("\n");
-        }
-    } catch (const std::exception& ex) {
-        printf("Error: %s\n", ex.what());
-    }
-
-    return 0;
-}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstring>
+#include "fitnesscache.h"
+
+namespace {
+
+uint64_t hashValues(uint64_t hash, std::span<const double> values) {
+    hash ^= values.size();
+    hash *= 0x100000001b3ULL;
+    for (double value : values) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hash ^= bits;
+        hash *= 0x100000001b3ULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+} // namespace
+
+FitnessCache::FitnessCache(size_t capacity, size_t shard_count) {
+    shard_count = std::max<size_t>(1, shard_count);
+    shard_capacity = std::max<size_t>(1, (capacity + shard_count - 1) / shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+        shards.back()->entries.reserve(shard_capacity);
+    }
+}
+
+uint64_t FitnessCache::datasetId(std::span<const double> x_values, std::span<const double> desired_output, const SeriesLayout* series) {
+    uint64_t hash = hashValues(hashValues(0xcbf29ce484222325ULL, x_values), desired_output);
+    if (series) {
+        std::vector<double> shape(series->offsets.begin(), series->offsets.end());
+        shape.push_back(static_cast<double>(series->aggregate));
+        if (series->aggregate == SeriesAggregate::Weighted) {
+            shape.insert(shape.end(), series->weights.begin(), series->weights.end());
+        }
+        hash = hashValues(hash, shape);
+    }
+    return hash;
+}
+
+FitnessKey FitnessCache::makeKey(const Program& program, uint64_t dataset_id, Program& scratch) {
+    canonicalizeProgram(program, scratch);
+    return {hashProgram(scratch, dataset_id), hashProgram(scratch, ~dataset_id * 0x9e3779b97f4a7c15ULL)};
+}
+
+bool FitnessCache::lookup(const FitnessKey& key, double& score) {
+    Shard& shard = shardFor(key.hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key.hash);
+    if (it == shard.entries.end() || it->second.check != key.check) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    hits.fetch_add(1, std::memory_order_relaxed);
+    score = it->second.score;
+    return true;
+}
+
+void FitnessCache::insert(const FitnessKey& key, double score) {
+    Shard& shard = shardFor(key.hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key.hash);
+    if (it != shard.entries.end()) {
+        it->second = {key.check, score};
+        return;
+    }
+    if (shard.insertion_order.size() < shard_capacity) {
+        shard.insertion_order.push_back(key.hash);
+    } else {
+        shard.entries.erase(shard.insertion_order[shard.oldest]);
+        shard.insertion_order[shard.oldest] = key.hash;
+        shard.oldest = (shard.oldest + 1) % shard_capacity;
+    }
+    shard.entries.emplace(key.hash, Entry{key.check, score});
+}
+
+void FitnessCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->entries.clear();
+        shard->insertion_order.clear();
+        shard->oldest = 0;
+    }
+    hits.store(0);
+    misses.store(0);
+}
+
+size_t FitnessCache::getHits() const {
+    return hits.load(std::memory_order_relaxed);
+}
+
+size_t FitnessCache::getMisses() const {
+    return misses.load(std::memory_order_relaxed);
+}
+
+size_t FitnessCache::getSize() const {
+    size_t size = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        size += shard->entries.size();
+    }
+    return size;
+}
+
+FitnessCache::Shard& FitnessCache::shardFor(uint64_t hash) {
+    return *shards[(hash >> 48) % shards.size()];
+}
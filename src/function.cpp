@@ -1,170 +1,289 @@
-#include <iostream>
-#include <vector>
-#include <string>
+#include <algorithm>
 #include <cmath>
-#include <regex>
-#include <stdexcept>
+#include <memory>
 #include <sstream>
-#include <random>
-#include <algorithm>
+#include <stdexcept>
+#include "function.h"
 
-class Function {
-public:
-    Function(const std::vector<std::string>& instructions, const std::string& expression)
-        : instructions(instructions), expression(expression), score(0.0) {}
-
-    static Function createFromInstructions(const std::string& instruction_string) {
-        std::vector<std::string> instructions;
-        try {
-            std::istringstream iss(instruction_string);
-            std::string item;
-            while (std::getline(iss, item, ',')) {
-                instructions.push_back(item);
-            }
-        } catch (...) {
-            throw std::invalid_argument("Invalid instruction string format");
-        }
+Function::Function(const std::vector<std::string>& instructions, const std::string& expression)
+    : instructions(instructions), expression(expression), score(0.0) {}
 
-        if (instructions.empty() || instructions[0] != "y = x") {
-            throw std::invalid_argument("Instructions must start with 'y = x'");
+Function Function::createFromInstructions(const std::string& instruction_string) {
+    std::vector<std::string> instructions;
+    try {
+        std::istringstream iss(instruction_string);
+        std::string item;
+        while (std::getline(iss, item, ',')) {
+            instructions.push_back(item);
         }
+    } catch (...) {
+        throw std::invalid_argument("Invalid instruction string format");
+    }
 
-        Function instance(instructions, "");
-        instance.updateExpression();
-        return instance;
-    }
-
-    std::vector<double> calculate(const std::vector<double>& x_values) {
-        this->x_values = x_values;
-        std::vector<double> y_values;
-        for (double x : x_values) {
-            double y = x;
-            for (size_t i = 1; i < instructions.size(); ++i) {
-                const std::string& instruction = instructions[i];
-                if (instruction.find("y = y + ") != std::string::npos) {
-                    y += std::stod(instruction.substr(instruction.find("+") + 1));
-                } else if (instruction.find("y = y - ") != std::string::npos) {
-                    y -= std::stod(instruction.substr(instruction.find("-") + 1));
-                } else if (instruction.find("y = y * ") != std::string::npos) {
-                    y *= std::stod(instruction.substr(instruction.find("*") + 1));
-                } else if (instruction.find("y = y / ") != std::string::npos) {
-                    y /= std::stod(instruction.substr(instruction.find("/") + 1));
-                } else if (instruction.find("y = y ^ ") != std::string::npos) {
-                    y = std::pow(y, std::stod(instruction.substr(instruction.find("^") + 1)));
-                } else if (instruction == "y = ln(y)") {
-                    y = (y > 0) ? std::log(y) : NAN;
-                } else if (instruction == "y = sin(y)") {
-                    y = std::sin(y);
-                } else if (instruction == "y = cos(y)") {
-                    y = std::cos(y);
-                } else {
-                    y = std::stod(instruction.substr(instruction.find("=") + 1));
-                }
-            }
-            y_values.push_back(y);
-        }
-        return y_values;
+    if (instructions.empty() || instructions[0] != "y = x") {
+        throw std::invalid_argument("Instructions must start with 'y = x'");
     }
 
-    double evaluateSimilarity(const std::vector<double>& calculated_values, const std::vector<double>& desired_output) {
-        if (calculated_values.size() != desired_output.size()) {
-            throw std::invalid_argument("Calculated values and desired output must have the same length");
-        }
-        double squared_diff_sum = 0.0;
-        double abs_diff_sum = 0.0;
-        for (size_t i = 0; i < calculated_values.size(); ++i) {
-            double diff = calculated_values[i] - desired_output[i];
-            squared_diff_sum += diff * diff;
-            abs_diff_sum += std::abs(diff);
-        }
-        double rmse = std::sqrt(squared_diff_sum / calculated_values.size());
-        double mae = abs_diff_sum / calculated_values.size();
-        double similarity_score = 1.0 / (1.0 + rmse);
-        score = similarity_score;
-        return similarity_score;
+    Function instance(instructions, "");
+    instance.compile();
+    instance.updateExpression();
+    return instance;
+}
+
+Function Function::createFromProgram(const Program& program) {
+    std::vector<std::string> instructions = {"y = x"};
+    for (const Op& op : program) {
+        instructions.push_back(formatInstruction(op));
     }
+    Function instance(instructions, "");
+    instance.program = program;
+    instance.updateExpression();
+    return instance;
+}
 
-    void addInstruction(size_t index, const std::string& new_instruction) {
-        if (index < 1 || index > instructions.size()) {
-            throw std::out_of_range("Instruction index out of range");
-        }
-        instructions.insert(instructions.begin() + index, formatInstruction(new_instruction));
-        updateExpression();
+std::vector<double> Function::calculate(const std::vector<double>& x_values) {
+    std::vector<double> y_values(x_values.size());
+    evaluateProgram(program, x_values.data(), y_values.data(), x_values.size());
+    return y_values;
+}
+
+void Function::calculate(std::span<const double> x_values, double* y_values) const {
+    evaluateProgram(program, x_values.data(), y_values, x_values.size());
+}
+
+double Function::evaluateFitness(std::span<const double> x_values, std::span<const double> desired_output) {
+    if (x_values.size() != desired_output.size()) {
+        throw std::invalid_argument("Input values and desired output must have the same length");
     }
+    score = similarityScore(evaluateProgramError(program, x_values.data(), desired_output.data(), x_values.size()));
+    return score;
+}
 
-    void removeInstruction(size_t index) {
-        if (index < 1 || index >= instructions.size()) {
-            throw std::out_of_range("Instruction index out of range");
-        }
-        instructions.erase(instructions.begin() + index);
-        updateExpression();
+double Function::evaluateSimilarity(const std::vector<double>& calculated_values, const std::vector<double>& desired_output) {
+    if (calculated_values.size() != desired_output.size()) {
+        throw std::invalid_argument("Calculated values and desired output must have the same length");
     }
+    ErrorSums sums;
+    accumulateError(calculated_values.data(), desired_output.data(), calculated_values.size(), sums);
+    double similarity_score = similarityScore(sums);
+    score = similarity_score;
+    return similarity_score;
+}
 
-    void substituteInstruction(size_t index, const std::string& new_instruction) {
-        if (index < 1 || index >= instructions.size()) {
-            throw std::out_of_range("Instruction index out of range");
+// Resumes from the deepest stored prefix state that the last edit left
+// valid and records a new state every `interval` instructions, widening the
+// interval so the states fit in `max_bytes`. States are shared with copies
+// of this function until either side edits its program. The score is
+// identical to evaluateFitness, or to BatchEvaluator's for a `series`
+// layout.
+double Function::evaluateFitnessIncremental(std::span<const double> x_values, std::span<const double> desired_output, uint64_t dataset_id, size_t interval, size_t max_bytes, const SeriesLayout* series) {
+    if (x_values.size() != desired_output.size()) {
+        throw std::invalid_argument("Input values and desired output must have the same length");
+    }
+    if (prefix_dataset_id != dataset_id) {
+        prefix_states.clear();
+        prefix_dataset_id = dataset_id;
+    }
+    const size_t count = x_values.size();
+    const size_t max_states = max_bytes / std::max<size_t>(1, count * sizeof(double));
+    interval = std::max<size_t>(1, interval);
+    if (max_states > 0) {
+        interval = std::max(interval, (program.size() + max_states - 1) / max_states);
+    }
+
+    size_t start = 0;
+    const double* source = x_values.data();
+    if (!prefix_states.empty()) {
+        start = prefix_states.back().op_count;
+        source = prefix_states.back().values->data();
+    }
+    static thread_local std::vector<double> y_values;
+    y_values.assign(source, source + count);
+    for (size_t k = start; k < program.size(); ++k) {
+        applyOp(program[k], y_values.data(), count);
+        const size_t op_count = k + 1;
+        if (op_count < program.size() && op_count % interval == 0 && prefix_states.size() < max_states) {
+            prefix_states.push_back({op_count, std::make_shared<const std::vector<double>>(y_values)});
         }
-        instructions[index] = formatInstruction(new_instruction);
-        updateExpression();
     }
 
-private:
-    std::vector<std::string> instructions;
-    std::vector<double> x_values;
-    std::string expression;
-    double score;
-
-    std::string formatInstruction(const std::string& instruction) {
-        std::string formatted = instruction;
-        formatted = std::regex_replace(formatted, std::regex("\s*=\s*"), " = ");
-        formatted = std::regex_replace(formatted, std::regex("\s*\+\s*"), " + ");
-        formatted = std::regex_replace(formatted, std::regex("\s*-\s*"), " - ");
-        formatted = std::regex_replace(formatted, std::regex("\s*\*\s*"), " * ");
-        formatted = std::regex_replace(formatted, std::regex("\s*/\s*"), " / ");
-        formatted = std::regex_replace(formatted, std::regex("\s*\^\s*"), " ^ ");
-        formatted = std::regex_replace(formatted, std::regex("\b(ln|sin|cos)\s*\(\s*(.*?)\s*\)"), "$1($2)");
-        return formatted;
-    }
-
-    void updateExpression() {
-        expression = "x";
-        for (size_t i = 1; i < instructions.size(); ++i) {
-            const std::string& instruction = instructions[i];
-            if (instruction.find("y = y + ") != std::string::npos) {
-                expression = "(" + expression + " + " + instruction.substr(instruction.find("+") + 1) + ")";
-            } else if (instruction.find("y = y - ") != std::string::npos) {
-                expression = "(" + expression + " - " + instruction.substr(instruction.find("-") + 1) + ")";
-            } else if (instruction.find("y = y * ") != std::string::npos) {
-                expression = "(" + expression + " * " + instruction.substr(instruction.find("*") + 1) + ")";
-            } else if (instruction.find("y = y / ") != std::string::npos) {
-                expression = "(" + expression + " / " + instruction.substr(instruction.find("/") + 1) + ")";
-            } else if (instruction.find("y = y ^ ") != std::string::npos) {
-                expression = "(" + expression + ")^" + instruction.substr(instruction.find("^") + 1);
-            } else if (instruction == "y = ln(y)") {
-                expression = "ln(" + expression + ")";
-            } else if (instruction == "y = sin(y)") {
-                expression = "sin(" + expression + ")";
-            } else if (instruction == "y = cos(y)") {
-                expression = "cos(" + expression + ")";
-            }
+    if (series) {
+        static thread_local std::vector<ErrorSums> series_sums;
+        series_sums.assign(series->getSeriesCount(), ErrorSums());
+        for (size_t block = 0; block < count; block += kKernelBlockSize) {
+            accumulateSeriesError(y_values.data() + block, desired_output.data() + block, block, std::min(kKernelBlockSize, count - block), *series, series_sums.data());
         }
+        score = seriesSimilarityScore(series_sums.data(), *series);
+        return score;
+    }
+    ErrorSums sums;
+    for (size_t block = 0; block < count; block += kKernelBlockSize) {
+        accumulateError(y_values.data() + block, desired_output.data() + block, std::min(kKernelBlockSize, count - block), sums);
     }
-};
+    score = similarityScore(sums);
+    return score;
+}
 
-int main() {
-    try {
-        std::string instructions = "y = x, y = y + 5, y = y * 3";
-        Function func = Function::createFromInstructions(instructions);
-        std::vector<double> x_values = {1, 2, 3, 4};
-        std::vector<double> y_values = func.calculate(x_values);
+void Function::clearPrefixStates() {
+    prefix_states.clear();
+}
 
-        for (double y : y_values) {
-            std::cout << y << " ";
-        }
-        std::cout << std::endl;
-    } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+size_t Function::getPrefixStateBytes() const {
+    size_t bytes = 0;
+    for (const PrefixState& state : prefix_states) {
+        bytes += state.values->size() * sizeof(double);
+    }
+    return bytes;
+}
+
+void Function::addInstruction(size_t index, const std::string& new_instruction) {
+    if (index < 1 || index > instructions.size()) {
+        throw std::out_of_range("Instruction index out of range");
     }
+    std::string normalized;
+    Op op = parseInstruction(new_instruction, normalized);
+    instructions.insert(instructions.begin() + index, std::move(normalized));
+    program.insert(program.begin() + (index - 1), op);
+    invalidatePrefixStates(index - 1);
+    updateExpression();
+}
+
+void Function::removeInstruction(size_t index) {
+    if (index < 1 || index >= instructions.size()) {
+        throw std::out_of_range("Instruction index out of range");
+    }
+    instructions.erase(instructions.begin() + index);
+    program.erase(program.begin() + (index - 1));
+    invalidatePrefixStates(index - 1);
+    updateExpression();
+}
+
+void Function::substituteInstruction(size_t index, const std::string& new_instruction) {
+    if (index < 1 || index >= instructions.size()) {
+        throw std::out_of_range("Instruction index out of range");
+    }
+    program[index - 1] = parseInstruction(new_instruction, instructions[index]);
+    invalidatePrefixStates(index - 1);
+    updateExpression();
+}
+
+void Function::setOperand(size_t index, double operand) {
+    if (index < 1 || index >= instructions.size()) {
+        throw std::out_of_range("Instruction index out of range");
+    }
+    Op& op = program[index - 1];
+    if (op.code == OpCode::Ln || op.code == OpCode::Sin || op.code == OpCode::Cos) {
+        throw std::invalid_argument("Instruction has no operand: " + instructions[index]);
+    }
+    op.operand = operand;
+    instructions[index] = formatInstruction(op);
+    invalidatePrefixStates(index - 1);
+    updateExpression();
+}
+
+double Function::getScore() const {
+    return score;
+}
+
+void Function::setScore(double score) {
+    this->score = score;
+}
+
+const std::string& Function::getExpression() const {
+    return expression;
+}
+
+const std::vector<std::string>& Function::getInstructions() const {
+    return instructions;
+}
+
+const Program& Function::getProgram() const {
+    return program;
+}
+
+void Function::reserve(size_t op_count, size_t expression_length) {
+    instructions.reserve(op_count + 1);
+    program.reserve(op_count);
+    expression.reserve(expression_length);
+}
+
+void Function::invalidatePrefixStates(size_t op_count) {
+    while (!prefix_states.empty() && prefix_states.back().op_count > op_count) {
+        prefix_states.pop_back();
+    }
+}
+
+void Function::compile() {
+    program.clear();
+    program.reserve(instructions.size() - 1);
+    std::string normalized;
+    for (size_t i = 1; i < instructions.size(); ++i) {
+        program.push_back(parseInstruction(instructions[i], normalized));
+        instructions[i].swap(normalized);
+    }
+}
 
-    return 0;
+// Binary instructions are stored as "y = y <op> <operand>" and constants as
+// "y = <operand>", so the operand text starts at a fixed offset. The ops
+// after the last constant (or all of them, around x) nest outward, so the
+// opening parts are written last op first and the closing parts in program
+// order; building in place keeps the string's storage across edits.
+void Function::updateExpression() {
+    size_t base = 0;
+    for (size_t k = program.size(); k-- > 0;) {
+        if (program[k].code == OpCode::Set) {
+            base = k + 1;
+            break;
+        }
+    }
+    expression.clear();
+    for (size_t k = program.size(); k-- > base;) {
+        switch (program[k].code) {
+            case OpCode::Ln: expression += "ln("; break;
+            case OpCode::Sin: expression += "sin("; break;
+            case OpCode::Cos: expression += "cos("; break;
+            default: expression += '('; break;
+        }
+    }
+    if (base == 0) {
+        expression += 'x';
+    } else {
+        expression.append(instructions[base], 4);
+    }
+    for (size_t k = base; k < program.size(); ++k) {
+        const std::string& instruction = instructions[k + 1];
+        switch (program[k].code) {
+            case OpCode::Add:
+                expression += " + ";
+                expression.append(instruction, 8);
+                expression += ')';
+                break;
+            case OpCode::Sub:
+                expression += " - ";
+                expression.append(instruction, 8);
+                expression += ')';
+                break;
+            case OpCode::Mul:
+                expression += " * ";
+                expression.append(instruction, 8);
+                expression += ')';
+                break;
+            case OpCode::Div:
+                expression += " / ";
+                expression.append(instruction, 8);
+                expression += ')';
+                break;
+            case OpCode::Pow:
+                expression += ")^";
+                expression.append(instruction, 8);
+                break;
+            case OpCode::Ln:
+            case OpCode::Sin:
+            case OpCode::Cos:
+                expression += ')';
+                break;
+            case OpCode::Set:
+                break;
+        }
+    }
 }
@@ -1,98 +1,563 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <regex>
 #include <stdexcept>
-#include <random>
 #include <algorithm>
 #include <cmath>
-#include <sstream>
-#include "function.h"
+#include <memory>
+#include <thread>
+#include <numeric>
+#include <limits>
+#include <functional>
+#include <filesystem>
+#include <tuple>
+#include "geneticalgo.h"
 
-class GeneticAlgorithm {
-public:
-    GeneticAlgorithm(const std::vector<std::vector<double>>& time_value, const std::vector<std::vector<double>>& desired_output, int population_size, int generations)
-        : time_value(time_value), desired_output(desired_output), population_size(population_size), generations(generations) {}
+GeneticAlgorithm::GeneticAlgorithm(const std::vector<std::vector<double>>& time_value, const std::vector<std::vector<double>>& desired_output, int population_size, int generations, const GeneticAlgorithmOptions& options)
+    : time_value(time_value), desired_output(desired_output), x_values(this->time_value.at(0)), desired_values(this->desired_output.at(0)), population_size(population_size), generations(generations), options(options) {
+    setUpEvaluation();
+}
+
+GeneticAlgorithm::GeneticAlgorithm(std::span<const double> x_values, std::span<const double> desired_values, int population_size, int generations, const GeneticAlgorithmOptions& options)
+    : x_values(x_values), desired_values(desired_values), population_size(population_size), generations(generations), options(options) {
+    setUpEvaluation();
+}
 
-    void run() {
-        generateInitialPopulation();
-        for (int generation = 0; generation < generations; ++generation) {
-            std::cout << "\nGeneration " << generation << "\n";
-            evaluatePopulation();
-            selectBestIndividuals();
-            performMutation();
+Function GeneticAlgorithm::run() {
+    const std::string& path = options.checkpoint_path;
+    if (options.resume && !path.empty() && std::filesystem::exists(path)) {
+        restore(loadCheckpoint(path));
+    } else {
+        initialize();
+    }
+    while (current_generation < generations) {
+        std::cout << "\nGeneration " << current_generation << "\n";
+        step();
+        const bool due = options.checkpoint_interval > 0 && (current_generation % options.checkpoint_interval == 0 || current_generation == generations);
+        if (due && !path.empty()) {
+            saveCheckpoint(path, checkpoint());
         }
-        Function best_function = getBestFunction();
-        std::cout << "\nBest Function: " << best_function.getExpression() << "\n";
     }
+    Function best_function = getBestFunction();
+    std::cout << "\nBest Function: " << best_function.getExpression() << "\n";
+    return best_function;
+}
 
-private:
-    std::vector<std::vector<double>> time_value;
-    std::vector<std::vector<double>> desired_output;
-    int population_size;
-    int generations;
-    std::vector<Function> population;
+void GeneticAlgorithm::initialize() {
+    population.clear();
+    current_generation = 0;
+    survivor_count = 0;
+    best_score = 0.0;
+    generateInitialPopulation();
+    population_scored = false;
+}
 
-    void generateInitialPopulation() {
-        for (int i = 0; i < population_size; ++i) {
-            std::string instructions = generateRandomInstructions();
-            Function func = Function::createFromInstructions(instructions);
-            population.push_back(func);
+GaCheckpoint GeneticAlgorithm::checkpoint() const {
+    GaCheckpoint checkpoint;
+    checkpoint.seed = options.seed;
+    checkpoint.dataset_id = dataset_id;
+    checkpoint.population_size = population_size;
+    checkpoint.generation = current_generation;
+    checkpoint.survivor_count = survivor_count;
+    checkpoint.best_score = best_score;
+    checkpoint.skipped_samples = skipped_samples;
+    for (const Function& func : population) {
+        checkpoint.programs.push_back(func.getProgram());
+        checkpoint.scores.push_back(func.getScore());
+    }
+    return checkpoint;
+}
+
+// Children's scores are stale until the next evaluation, as they were when
+// the checkpoint was taken.
+void GeneticAlgorithm::restore(const GaCheckpoint& checkpoint) {
+    if (checkpoint.dataset_id != dataset_id) {
+        throw std::invalid_argument("Checkpoint was taken on a different data set");
+    }
+    if (checkpoint.population_size != population_size) {
+        throw std::invalid_argument("Checkpoint was taken with a different population size");
+    }
+    // Before the first step the population is complete; afterwards it is
+    // the survivors plus one child each.
+    const size_t keep = population_size / 2;
+    const size_t count = checkpoint.programs.size();
+    if (checkpoint.scores.size() != count || (count != static_cast<size_t>(population_size) && count != keep * 2) || checkpoint.survivor_count > keep) {
+        throw std::invalid_argument("Checkpoint population does not match the population size");
+    }
+    for (const Program& program : checkpoint.programs) {
+        if (program.empty()) {
+            throw std::invalid_argument("Checkpoint programs need at least one instruction after 'y = x'");
         }
     }
+    options.seed = checkpoint.seed;
+    population.clear();
+    for (size_t i = 0; i < checkpoint.programs.size(); ++i) {
+        population.push_back(Function::createFromProgram(checkpoint.programs[i]));
+        population.back().setScore(checkpoint.scores[i]);
+    }
+    current_generation = checkpoint.generation;
+    survivor_count = checkpoint.survivor_count;
+    best_score = checkpoint.best_score;
+    skipped_samples = checkpoint.skipped_samples;
+    population_scored = false;
+}
+
+void GeneticAlgorithm::step() {
+    MetricsRecorder* recorder = options.metrics.get();
+    GenerationMetrics metrics;
+    if (recorder) {
+        startGenerationMetrics(metrics);
+    }
+    PhaseTimer timer(recorder);
+    evaluatePopulation();
+    metrics.evaluate_seconds = timer.lap("evaluate");
+    if (recorder) {
+        collectEvaluationMetrics(metrics);
+        timer.restart();
+    }
+    selectBestIndividuals();
+    metrics.select_seconds = timer.lap("select");
+    refineSurvivors();
+    metrics.refine_seconds = timer.lap("refine");
+    best_score = population.empty() ? 0.0 : population.front().getScore();
+    performMutation();
+    metrics.mutate_seconds = timer.lap("mutate");
+    if (recorder) {
+        metrics.best_score = best_score;
+        recorder->recordGeneration(metrics);
+    }
+    ++current_generation;
+    population_scored = false;
+}
+
+Function GeneticAlgorithm::getBestFunction() {
+    if (!population_scored) {
+        evaluatePopulation();
+    }
+    return *std::min_element(population.begin(), population.end(), rankBefore);
+}
 
-    std::string generateRandomInstructions() {
-        static const std::vector<std::string> operations = {"y = y + 1", "y = y - 1", "y = y * 2", "y = y / 2", "y = sin(y)", "y = cos(y)", "y = ln(y)"};
-        std::string instructions = "y = x";
-        int steps = rand() % 4 + 2; // Between 2 to 5 instructions
-        for (int i = 0; i < steps; ++i) {
-            instructions += ", " + operations[rand() % operations.size()];
+std::vector<Function> GeneticAlgorithm::getTopIndividuals(size_t count) const {
+    count = std::min(count, survivor_count);
+    return std::vector<Function>(population.begin(), population.begin() + count);
+}
+
+void GeneticAlgorithm::immigrate(const std::vector<Function>& migrants) {
+    size_t replaceable = population.size() - survivor_count;
+    for (size_t j = 0; j < migrants.size() && j < replaceable; ++j) {
+        population[population.size() - 1 - j] = migrants[j];
+    }
+    population_scored = false;
+}
+
+double GeneticAlgorithm::getBestScore() const {
+    return best_score;
+}
+
+int GeneticAlgorithm::getGeneration() const {
+    return current_generation;
+}
+
+int GeneticAlgorithm::getGenerations() const {
+    return generations;
+}
+
+std::shared_ptr<FitnessCache> GeneticAlgorithm::getFitnessCache() const {
+    return cache;
+}
+
+size_t GeneticAlgorithm::getSkippedSamples() const {
+    return skipped_samples;
+}
+
+void GeneticAlgorithm::setUpEvaluation() {
+    for (const Program& program : options.warm_start) {
+        if (program.empty()) {
+            throw std::invalid_argument("Warm-start programs need at least one instruction after 'y = x'");
         }
-        return instructions;
     }
+    if (options.fit_all_series && time_value.size() > 1) {
+        concatenateSeries();
+    }
+    size_t thread_count = options.thread_count != 0 ? options.thread_count : std::max(1u, std::thread::hardware_concurrency());
+    pool = std::make_unique<ThreadPool>(thread_count - 1);
+    cache = options.fitness_cache;
+    if (!cache && options.cache_capacity > 0) {
+        cache = std::make_shared<FitnessCache>(options.cache_capacity);
+    }
+    dataset_id = FitnessCache::datasetId(x_values, desired_values, series());
+    evaluator.setMetrics(options.metrics.get());
+    if (options.metrics) {
+        metrics_run = options.metrics_run >= 0 ? static_cast<uint64_t>(options.metrics_run) : options.metrics->nextRunId();
+    }
+    if (options.jit && !options.incremental_evaluation) {
+        jit_cache = std::make_unique<JitCache>(options.jit_min_uses, options.jit_min_samples, 4096, options.jit_verify);
+    }
+}
 
-    void evaluatePopulation() {
-        for (Function& func : population) {
-            std::vector<double> results = func.calculate(time_value[0]);
-            double score = func.evaluateSimilarity(results, desired_output[0]);
-            std::cout << "Function: " << func.getExpression() << ", Similarity Score: " << score << "\n";
+// Lays every series end to end so each program runs once over all of them.
+void GeneticAlgorithm::concatenateSeries() {
+    if (time_value.size() != desired_output.size()) {
+        throw std::invalid_argument("time_value and desired_output must hold the same number of series");
+    }
+    if (options.series_aggregate == SeriesAggregate::Weighted && options.series_weights.size() != time_value.size()) {
+        throw std::invalid_argument("Weighted aggregation needs one weight per series");
+    }
+    series_offsets.assign(1, 0);
+    for (size_t s = 0; s < time_value.size(); ++s) {
+        if (time_value[s].empty() || time_value[s].size() != desired_output[s].size()) {
+            throw std::invalid_argument("Every series needs matching, non-empty input and desired output");
         }
+        series_x.insert(series_x.end(), time_value[s].begin(), time_value[s].end());
+        series_desired.insert(series_desired.end(), desired_output[s].begin(), desired_output[s].end());
+        series_offsets.push_back(series_x.size());
     }
+    x_values = series_x;
+    desired_values = series_desired;
+    series_layout = {series_offsets, options.series_aggregate, options.series_weights};
+}
 
-    void selectBestIndividuals() {
-        std::sort(population.begin(), population.end(), [](const Function& a, const Function& b) {
-            return a.getScore() > b.getScore();
-        });
-        population.resize(population_size / 2); // Keep top 50%
+const SeriesLayout* GeneticAlgorithm::series() const {
+    return series_offsets.empty() ? nullptr : &series_layout;
+}
+
+// Higher scores first; NaN scores (undefined on the data) rank last.
+bool GeneticAlgorithm::rankBefore(const Function& a, const Function& b) {
+    if (std::isnan(b.getScore())) {
+        return !std::isnan(a.getScore());
+    }
+    return a.getScore() > b.getScore();
+}
+
+// Stream 0 of each generation block seeds the initial population; child i
+// of generation g always draws from the same stream.
+Rng GeneticAlgorithm::streamRng(int generation, size_t index) const {
+    return Rng(options.seed, (static_cast<uint64_t>(generation + 1) << 32) | index);
+}
+
+// Warm-start programs take the first places; random individuals keep the
+// stream of their index either way.
+void GeneticAlgorithm::generateInitialPopulation() {
+    for (int i = 0; i < population_size; ++i) {
+        if (static_cast<size_t>(i) < options.warm_start.size()) {
+            population.push_back(Function::createFromProgram(options.warm_start[i]));
+            continue;
+        }
+        Rng rng = streamRng(-1, i);
+        std::string instructions = generateRandomInstructions(rng);
+        Function func = Function::createFromInstructions(instructions);
+        population.push_back(func);
+    }
+}
+
+std::string GeneticAlgorithm::generateRandomInstructions(Rng& rng) {
+    static const std::vector<std::string> operations = {"y = y + 1", "y = y - 1", "y = y * 2", "y = y / 2", "y = sin(y)", "y = cos(y)", "y = ln(y)"};
+    std::string instructions = "y = x";
+    int steps = rng.uniform(4) + 2; // Between 2 to 5 instructions
+    for (int i = 0; i < steps; ++i) {
+        instructions += ", " + operations[rng.uniform(operations.size())];
+    }
+    return instructions;
+}
+
+void GeneticAlgorithm::evaluatePopulation() {
+    raced_out.assign(population.size(), 0);
+    const size_t keep = population_size / 2;
+    if (options.racing && keep > 0 && survivor_count >= keep && survivor_count < population.size()) {
+        // The previous survivors are scored in full first; children then
+        // race against the worst score selection could still keep.
+        evaluateRange(0, survivor_count, -std::numeric_limits<double>::infinity());
+        evaluateRange(survivor_count, population.size(), selectionCutoff(keep));
+    } else {
+        evaluateRange(0, population.size(), -std::numeric_limits<double>::infinity());
+    }
+    population_scored = true;
+    if (options.log_candidates) {
+        for (const Function& func : population) {
+            std::cout << "Function: " << func.getExpression() << ", Similarity Score: " << func.getScore() << "\n";
+        }
+    }
+}
+
+// Cumulative counters are read before the generation so that
+// collectEvaluationMetrics can store the difference.
+void GeneticAlgorithm::startGenerationMetrics(GenerationMetrics& metrics) const {
+    metrics.run = metrics_run;
+    metrics.generation = current_generation;
+    metrics.cache_hits = cache ? cache->getHits() : 0;
+    metrics.cache_misses = cache ? cache->getMisses() : 0;
+    metrics.skipped_samples = skipped_samples;
+    metrics.jit_compiled = jit_cache ? jit_cache->getCompiledCount() : 0;
+}
+
+// Only runs with a recorder: hashing and the median cost a pass over the
+// population.
+void GeneticAlgorithm::collectEvaluationMetrics(GenerationMetrics& metrics) {
+    metrics.evaluations = population.size();
+    metrics.cache_hits = cache ? cache->getHits() - metrics.cache_hits : 0;
+    metrics.cache_misses = cache ? cache->getMisses() - metrics.cache_misses : 0;
+    metrics.skipped_samples = skipped_samples - metrics.skipped_samples;
+    metrics.jit_compiled = jit_cache ? jit_cache->getCompiledCount() - metrics.jit_compiled : 0;
+    metrics.raced_out = std::count(raced_out.begin(), raced_out.end(), 1);
+    if (population.empty()) {
+        return;
+    }
+
+    metrics_scores.clear();
+    metrics_hashes.clear();
+    for (const Function& func : population) {
+        metrics_scores.push_back(func.getScore());
+        metrics_hashes.push_back(hashProgram(func.getProgram(), 0));
+    }
+    // NaN scores rank last, as in selection.
+    auto middle = metrics_scores.begin() + metrics_scores.size() / 2;
+    std::nth_element(metrics_scores.begin(), middle, metrics_scores.end(), [](double a, double b) {
+        return std::isnan(b) ? !std::isnan(a) : a > b;
+    });
+    metrics.median_score = *middle;
+    std::sort(metrics_hashes.begin(), metrics_hashes.end());
+    size_t distinct = std::unique(metrics_hashes.begin(), metrics_hashes.end()) - metrics_hashes.begin();
+    metrics.diversity = static_cast<double>(distinct) / population.size();
+}
+
+void GeneticAlgorithm::evaluateRange(size_t begin, size_t end, double cutoff) {
+    if (cache) {
+        evaluateWithCache(begin, end, cutoff);
+    } else {
+        candidate_indices.resize(end - begin);
+        std::iota(candidate_indices.begin(), candidate_indices.end(), static_cast<uint32_t>(begin));
+        scoreCandidates(candidate_indices, cutoff);
+    }
+}
+
+// The keep-th best score among the previous survivors; any candidate
+// scoring below it cannot be selected. No cutoff when one is NaN.
+double GeneticAlgorithm::selectionCutoff(size_t keep) {
+    cutoff_scratch.clear();
+    for (size_t i = 0; i < survivor_count; ++i) {
+        if (std::isnan(population[i].getScore())) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        cutoff_scratch.push_back(population[i].getScore());
     }
+    std::nth_element(cutoff_scratch.begin(), cutoff_scratch.begin() + (keep - 1), cutoff_scratch.end(), std::greater<double>());
+    return cutoff_scratch[keep - 1];
+}
 
-    void performMutation() {
-        int original_size = population.size();
-        for (int i = 0; i < original_size; ++i) {
-            Function mutated_function = population[i];
-            int index = rand() % (mutated_function.getInstructions().size() - 1) + 1;
-            std::string new_instruction = generateRandomInstruction();
-            mutated_function.substituteInstruction(index, new_instruction);
-            population.push_back(mutated_function);
+// Lookups and inserts happen on this thread in a fixed order, so the cache
+// contents (and therefore the run) stay independent of the thread count.
+// Abandoned candidates only carry a bound and are not inserted.
+void GeneticAlgorithm::evaluateWithCache(size_t begin, size_t end, double cutoff) {
+    cache_keys.resize(population.size());
+    cache_misses.clear();
+    for (size_t i = begin; i < end; ++i) {
+        cache_keys[i] = FitnessCache::makeKey(population[i].getProgram(), dataset_id, canonical_scratch);
+        double score;
+        if (cache->lookup(cache_keys[i], score)) {
+            population[i].setScore(score);
+        } else {
+            cache_misses.push_back(i);
         }
     }
 
-    std::string generateRandomInstruction() {
-        static const std::vector<std::string> operations = {"y = y + 1", "y = y - 1", "y = y * 2", "y = y / 2", "y = sin(y)", "y = cos(y)", "y = ln(y)"};
-        return operations[rand() % operations.size()];
+    // Equivalent programs within a generation are evaluated once, by the lowest index.
+    // Keys match only when both hashes do, as in FitnessCache::lookup.
+    auto sameKey = [this](uint32_t a, uint32_t b) {
+        return cache_keys[a].hash == cache_keys[b].hash && cache_keys[a].check == cache_keys[b].check;
+    };
+    // Ties are broken by index, which std::sort does without stable_sort's
+    // temporary buffer.
+    std::sort(cache_misses.begin(), cache_misses.end(), [this](uint32_t a, uint32_t b) {
+        return std::tie(cache_keys[a].hash, cache_keys[a].check, a) < std::tie(cache_keys[b].hash, cache_keys[b].check, b);
+    });
+    unique_misses.clear();
+    for (size_t m = 0; m < cache_misses.size(); ++m) {
+        if (m == 0 || !sameKey(cache_misses[m], cache_misses[m - 1])) {
+            unique_misses.push_back(cache_misses[m]);
+        }
     }
+    scoreCandidates(unique_misses, cutoff);
 
-    Function getBestFunction() {
-        return *std::max_element(population.begin(), population.end(), [](const Function& a, const Function& b) {
-            return a.getScore() < b.getScore();
+    uint32_t representative = 0;
+    for (size_t m = 0; m < cache_misses.size(); ++m) {
+        uint32_t index = cache_misses[m];
+        if (m == 0 || !sameKey(index, cache_misses[m - 1])) {
+            representative = index;
+            if (!raced_out[index]) {
+                cache->insert(cache_keys[index], population[index].getScore());
+            }
+        }
+        population[index].setScore(population[representative].getScore());
+    }
+}
+
+// Racing against `cutoff` only applies to candidates scored by the batch
+// evaluator.
+void GeneticAlgorithm::scoreCandidates(const std::vector<uint32_t>& indices, double cutoff) {
+    if (options.incremental_evaluation) {
+        size_t budget = options.prefix_state_bytes / std::max(1, population_size);
+        pool->parallelFor(indices.size(), 4, [&](size_t begin, size_t end) {
+            ScopedSpan span(options.metrics.get(), "evaluate_incremental");
+            for (size_t j = begin; j < end; ++j) {
+                population[indices[j]].evaluateFitnessIncremental(x_values, desired_values, dataset_id, options.prefix_state_interval, budget, series());
+            }
         });
+        return;
+    }
+    if (jit_cache) {
+        scoreWithJit(indices, cutoff);
+        return;
     }
-};
+    scoreInterpreted(indices, cutoff);
+}
+
+void GeneticAlgorithm::scoreInterpreted(const std::vector<uint32_t>& indices, double cutoff) {
+    evaluator.load(population, indices);
+    evaluator.evaluate(x_values, desired_values, pool.get(), series(), cutoff);
+    const std::vector<double>& scores = evaluator.getScores();
+    const std::vector<uint8_t>& abandoned = evaluator.getAbandoned();
+    for (uint32_t index : indices) {
+        population[index].setScore(scores[index]);
+        raced_out[index] = abandoned[index];
+    }
+    skipped_samples += evaluator.getSkippedSamples();
+}
+
+// Hot programs run natively, one candidate per task; the rest go through
+// the batch evaluator. Which programs are hot depends only on the order
+// of requests made here, not on the thread count.
+void GeneticAlgorithm::scoreWithJit(const std::vector<uint32_t>& indices, double cutoff) {
+    native_indices.clear();
+    native_code.clear();
+    interpreted_indices.clear();
+    for (uint32_t index : indices) {
+        std::shared_ptr<const JitProgram> code = jit_cache->acquire(population[index].getProgram(), x_values);
+        if (code) {
+            native_indices.push_back(index);
+            native_code.push_back(std::move(code));
+        } else {
+            interpreted_indices.push_back(index);
+        }
+    }
+    pool->parallelFor(native_indices.size(), 1, [this](size_t begin, size_t end) {
+        ScopedSpan span(options.metrics.get(), "evaluate_native");
+        for (size_t j = begin; j < end; ++j) {
+            population[native_indices[j]].setScore(native_code[j]->evaluateScore(x_values.data(), desired_values.data(), x_values.size(), series()));
+        }
+    });
+    if (!interpreted_indices.empty()) {
+        scoreInterpreted(interpreted_indices, cutoff);
+    }
+}
+
+// Indices are ranked instead of Functions, and only the top half is sorted.
+// Ties go to the lower index, exactly as a stable sort would order them,
+// so selection does not depend on the scores of candidates that are not
+// selected (racing changes only those). Survivors are swapped into the back
+// buffer, which then becomes the population; its slots past the survivors
+// hold stale Functions whose storage performMutation reuses.
+void GeneticAlgorithm::selectBestIndividuals() {
+    const size_t keep = std::min(population.size(), static_cast<size_t>(population_size / 2)); // Keep top 50%
+    ranking.resize(population.size());
+    std::iota(ranking.begin(), ranking.end(), 0);
+    std::partial_sort(ranking.begin(), ranking.begin() + keep, ranking.end(), [this](uint32_t a, uint32_t b) {
+        if (rankBefore(population[a], population[b])) {
+            return true;
+        }
+        return !rankBefore(population[b], population[a]) && a < b;
+    });
+    for (size_t i = 0; i < keep; ++i) {
+        if (i < next_population.size()) {
+            std::swap(next_population[i], population[ranking[i]]);
+        } else {
+            next_population.push_back(std::move(population[ranking[i]]));
+        }
+    }
+    population.swap(next_population);
+    survivor_count = keep;
+}
+
+// Each survivor is refined independently, so the result does not depend
+// on the thread count.
+void GeneticAlgorithm::refineSurvivors() {
+    const size_t count = std::min(options.refine_count, survivor_count);
+    if (count == 0) {
+        return;
+    }
+    pool->parallelFor(count, 1, [this](size_t begin, size_t end) {
+        ScopedSpan span(options.metrics.get(), "refine_candidates");
+        for (size_t i = begin; i < end; ++i) {
+            refineCandidate(population[i]);
+        }
+    });
+    std::sort(population.begin(), population.begin() + survivor_count, rankBefore);
+}
+
+void GeneticAlgorithm::refineCandidate(Function& candidate) {
+    const Program& program = candidate.getProgram();
+    Program tuned = program;
+    refineConstants(tuned, x_values, desired_values, options.refine_iterations);
+    // The fit minimizes the pooled squared error; the kernel score decides.
+    double score = evaluateProgramScore(tuned, x_values.data(), desired_values.data(), x_values.size(), series());
+    if (!(score > candidate.getScore())) {
+        return;
+    }
+    for (size_t k = 0; k < tuned.size(); ++k) {
+        if (tuned[k].operand != program[k].operand) {
+            candidate.setOperand(k + 1, tuned[k].operand);
+        }
+    }
+    candidate.setScore(score);
+}
+
+// Child i is copied over a stale slot of the population, reusing its
+// strings and vectors; the vector only grows until both buffers are full.
+void GeneticAlgorithm::performMutation() {
+    const size_t original_size = survivor_count;
+    if (population.size() > original_size * 2) {
+        population.erase(population.begin() + original_size * 2, population.end());
+    }
+    const size_t recycled = population.size() - original_size;
+    population.reserve(original_size * 2);
+    for (size_t i = recycled; i < original_size; ++i) {
+        population.push_back(population[i]);
+    }
+    // Every Function in both buffers is grown with headroom past the longest
+    // parent, since a child's expression can outgrow it. Functions move
+    // between buffers and slots, so all of them are grown at once; copies into
+    // a slot then reuse its storage until a parent outgrows the headroom.
+    size_t ops = 0;
+    size_t expression_length = 0;
+    for (size_t i = 0; i < original_size; ++i) {
+        ops = std::max(ops, population[i].getProgram().size());
+        expression_length = std::max(expression_length, population[i].getExpression().size());
+    }
+    if (ops > slot_ops || expression_length + 16 > slot_expression) {
+        slot_ops = std::max(slot_ops, ops + ops / 2);
+        slot_expression = std::max(slot_expression, (expression_length + 16) * 3 / 2);
+        for (Function& func : population) {
+            func.reserve(slot_ops, slot_expression);
+        }
+        for (Function& func : next_population) {
+            func.reserve(slot_ops, slot_expression);
+        }
+    }
+    pool->parallelFor(original_size, 8, [this, original_size, recycled](size_t begin, size_t end) {
+        ScopedSpan span(options.metrics.get(), "mutate_children");
+        for (size_t i = begin; i < end; ++i) {
+            Rng rng = streamRng(current_generation, i);
+            Function& mutated_function = population[original_size + i];
+            if (i < recycled) {
+                mutated_function.reserve(slot_ops, slot_expression);
+                mutated_function = population[i];
+            }
+            size_t index = rng.uniform(mutated_function.getInstructions().size() - 1) + 1;
+            mutated_function.substituteInstruction(index, generateRandomInstruction(rng));
+        }
+    });
+}
 
-int main() {
-    std::vector<std::vector<double>> time_value = {{1, 2, 3, 4, 5}};
-    std::vector<std::vector<double>> desired_output = {{2, 4, 6, 8, 10}};
-    GeneticAlgorithm ga(time_value, desired_output, 10, 5);
-    ga.run();
-    return 0;
+const std::string& GeneticAlgorithm::generateRandomInstruction(Rng& rng) {
+    static const std::vector<std::string> operations = {"y = y + 1", "y = y - 1", "y = y * 2", "y = y / 2", "y = sin(y)", "y = cos(y)", "y = ln(y)"};
+    return operations[rng.uniform(operations.size())];
 }
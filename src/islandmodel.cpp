@@ -0,0 +1,137 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "islandmodel.h"
+#include "geneticalgo.h"
+#include "fitnesscache.h"
+#include "lockfreequeue.h"
+#include "rng.h"
+
+IslandModel::IslandModel(const std::vector<std::vector<double>>& time_value, const std::vector<std::vector<double>>& desired_output, int population_size, int generations, const IslandOptions& options)
+    : time_value(time_value), desired_output(desired_output), population_size(population_size), generations(generations), options(options) {
+    if (this->options.island_count == 0) {
+        throw std::invalid_argument("IslandModel needs at least one island.");
+    }
+}
+
+IslandResult IslandModel::run() {
+    using Clock = std::chrono::steady_clock;
+    const size_t island_count = options.island_count;
+
+    GeneticAlgorithmOptions ga_options = options.ga;
+    if (ga_options.thread_count == 0) {
+        ga_options.thread_count = 1;
+    }
+    // Islands evaluate the same data set, so one cache serves all of them.
+    if (!ga_options.fitness_cache && ga_options.cache_capacity > 0) {
+        ga_options.fitness_cache = std::make_shared<FitnessCache>(ga_options.cache_capacity);
+    }
+
+    std::vector<std::unique_ptr<GeneticAlgorithm>> islands;
+    std::vector<std::unique_ptr<LockFreeQueue<Function>>> inboxes;
+    for (size_t i = 0; i < island_count; ++i) {
+        GeneticAlgorithmOptions island_options = ga_options;
+        island_options.seed = ga_options.seed + i;
+        island_options.metrics_run = static_cast<int64_t>(i);
+        islands.push_back(std::make_unique<GeneticAlgorithm>(time_value, desired_output, population_size, generations, island_options));
+        inboxes.push_back(std::make_unique<LockFreeQueue<Function>>(options.migrant_count * 4));
+    }
+
+    std::atomic<bool> stop{false};
+    std::exception_ptr error;
+    std::mutex target_mutex;
+    bool reached_target = false;
+    double seconds_to_target = 0.0;
+    int generations_to_target = 0;
+    const Clock::time_point start = Clock::now();
+
+    auto runIsland = [&](size_t index) {
+        GeneticAlgorithm& ga = *islands[index];
+        Rng rng(ga_options.seed, index);
+        std::vector<Function> arrivals;
+        ga.initialize();
+        while (ga.getGeneration() < generations && !stop.load(std::memory_order_relaxed)) {
+            ga.step();
+
+            if (ga.getBestScore() >= options.target_score) {
+                std::lock_guard<std::mutex> lock(target_mutex);
+                if (!reached_target) {
+                    reached_target = true;
+                    seconds_to_target = std::chrono::duration<double>(Clock::now() - start).count();
+                    generations_to_target = ga.getGeneration();
+                }
+                if (options.stop_at_target) {
+                    stop.store(true, std::memory_order_relaxed);
+                }
+            }
+
+            if (island_count > 1 && options.migration_interval > 0 && ga.getGeneration() % options.migration_interval == 0) {
+                size_t target = (index + 1) % island_count;
+                if (options.topology == IslandOptions::Topology::Random) {
+                    target = (index + 1 + rng.uniform(island_count - 1)) % island_count;
+                }
+                // A full inbox means the neighbour is behind; dropping the
+                // migrants keeps this island from waiting on it.
+                for (Function& migrant : ga.getTopIndividuals(options.migrant_count)) {
+                    if (!inboxes[target]->tryPush(std::move(migrant))) {
+                        break;
+                    }
+                }
+
+                arrivals.clear();
+                Function arrival = Function::createFromInstructions("y = x");
+                while (inboxes[index]->tryPop(arrival)) {
+                    arrivals.push_back(arrival);
+                }
+                ga.immigrate(arrivals);
+            }
+        }
+    };
+
+    // The first failure stops every island and is rethrown once all have joined.
+    auto guardedIsland = [&](size_t index) {
+        try {
+            runIsland(index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(target_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            stop.store(true, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < island_count; ++i) {
+        threads.emplace_back(guardedIsland, i);
+    }
+    guardedIsland(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    size_t best_island = 0;
+    std::vector<Function> bests;
+    for (size_t i = 0; i < island_count; ++i) {
+        bests.push_back(islands[i]->getBestFunction());
+        double score = bests[i].getScore();
+        if (!std::isnan(score) && !(score <= bests[best_island].getScore())) {
+            best_island = i;
+        }
+    }
+    double best_score = bests[best_island].getScore();
+    if (!reached_target && best_score >= options.target_score) {
+        reached_target = true;
+        seconds_to_target = std::chrono::duration<double>(Clock::now() - start).count();
+        generations_to_target = islands[best_island]->getGeneration();
+    }
+    double seconds_total = std::chrono::duration<double>(Clock::now() - start).count();
+    return {bests[best_island], best_score, best_island, reached_target, seconds_to_target, generations_to_target, seconds_total};
+}
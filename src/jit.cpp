@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool isArithmetic(OpCode code) {
+    return code == OpCode::Add || code == OpCode::Sub || code == OpCode::Mul || code == OpCode::Div || code == OpCode::Set;
+}
+
+#ifdef JIT_X86_64
+
+class Assembler {
+public:
+    std::vector<uint8_t> bytes;
+
+    void emit(std::initializer_list<uint8_t> values) {
+        bytes.insert(bytes.end(), values);
+    }
+
+    void emit32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            bytes.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+
+    void patch32(size_t at, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            bytes[at + i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    // <opcode> xmm0, [r8 + disp32] with the packed-double (66) prefix.
+    void packedWithConstant(uint8_t opcode, uint32_t displacement) {
+        emit({0x66, 0x41, 0x0F, opcode, 0x80});
+        emit32(displacement);
+    }
+};
+
+// One System V leaf function per segment: rdi = in, rsi = out, rdx = even
+// sample count. Only caller-saved registers are touched (rcx index, r8
+// constant table, xmm0 y), so there is no prologue. Constants are stored
+// twice (one per lane) in a 16-byte aligned table after all the code; the
+// table offsets are patched once its position is known.
+void generateSegment(const Program& program, size_t first_op, size_t op_count, Assembler& a, std::vector<double>& constants, std::vector<size_t>& table_fixups) {
+    a.emit({0x4C, 0x8D, 0x05});                     // lea r8, [rip + table]
+    table_fixups.push_back(a.bytes.size());
+    a.emit32(0);
+    a.emit({0x31, 0xC9});                           // xor ecx, ecx
+    a.emit({0x48, 0x85, 0xD2});                     // test rdx, rdx
+    a.emit({0x0F, 0x84});                           // je done
+    const size_t done_fixup = a.bytes.size();
+    a.emit32(0);
+
+    const size_t loop = a.bytes.size();
+    a.emit({0x66, 0x0F, 0x10, 0x04, 0xCF});         // movupd xmm0, [rdi + rcx * 8]
+    for (size_t k = first_op; k < first_op + op_count; ++k) {
+        const uint32_t displacement = static_cast<uint32_t>(constants.size() * sizeof(double));
+        switch (program[k].code) {
+            case OpCode::Add: a.packedWithConstant(0x58, displacement); break;
+            case OpCode::Sub: a.packedWithConstant(0x5C, displacement); break;
+            case OpCode::Mul: a.packedWithConstant(0x59, displacement); break;
+            case OpCode::Div: a.packedWithConstant(0x5E, displacement); break;
+            case OpCode::Set: a.packedWithConstant(0x28, displacement); break; // movapd
+            default: break;
+        }
+        constants.push_back(program[k].operand);
+        constants.push_back(program[k].operand);
+    }
+    a.emit({0x66, 0x0F, 0x11, 0x04, 0xCE});         // movupd [rsi + rcx * 8], xmm0
+    a.emit({0x48, 0x83, 0xC1, 0x02});               // add rcx, 2
+    a.emit({0x48, 0x39, 0xD1});                     // cmp rcx, rdx
+    a.emit({0x0F, 0x82});                           // jb loop
+    a.emit32(static_cast<uint32_t>(loop - (a.bytes.size() + 4)));
+    a.patch32(done_fixup, static_cast<uint32_t>(a.bytes.size() - (done_fixup + 4)));
+    a.emit({0xC3});                                 // ret
+}
+
+#endif
+
+bool sameProgram(const Program& a, const Program& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t k = 0; k < a.size(); ++k) {
+        if (a[k].code != b[k].code || std::memcmp(&a[k].operand, &b[k].operand, sizeof(double)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::unique_ptr<JitProgram> JitProgram::compile(const Program& program) {
+#ifdef JIT_X86_64
+    std::unique_ptr<JitProgram> compiled(new JitProgram());
+    compiled->program = program;
+    Assembler assembler;
+    std::vector<double> constants;
+    std::vector<size_t> table_fixups;
+    std::vector<size_t> entry_offsets;
+    for (size_t k = 0; k < program.size();) {
+        if (!isArithmetic(program[k].code)) {
+            compiled->segments.push_back({k, 1, nullptr});
+            entry_offsets.push_back(0);
+            ++k;
+            continue;
+        }
+        size_t end = k;
+        while (end < program.size() && isArithmetic(program[end].code)) {
+            ++end;
+        }
+        compiled->segments.push_back({k, end - k, nullptr});
+        entry_offsets.push_back(assembler.bytes.size());
+        generateSegment(program, k, end - k, assembler, constants, table_fixups);
+        k = end;
+    }
+    while (assembler.bytes.size() % 16 != 0) {
+        assembler.emit({0xCC});
+    }
+    const size_t table_offset = assembler.bytes.size();
+    for (size_t fixup : table_fixups) {
+        assembler.patch32(fixup, static_cast<uint32_t>(table_offset - (fixup + 4)));
+    }
+
+    const size_t size = table_offset + constants.size() * sizeof(double);
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t mapped_size = (std::max<size_t>(size, 1) + page - 1) / page * page;
+    void* memory = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, assembler.bytes.data(), table_offset);
+    std::memcpy(static_cast<uint8_t*>(memory) + table_offset, constants.data(), constants.size() * sizeof(double));
+    if (mprotect(memory, mapped_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, mapped_size);
+        return nullptr;
+    }
+    compiled->code = memory;
+    compiled->code_size = mapped_size;
+    for (size_t s = 0; s < compiled->segments.size(); ++s) {
+        if (isArithmetic(program[compiled->segments[s].first_op].code)) {
+            compiled->segments[s].entry = reinterpret_cast<Entry>(static_cast<uint8_t*>(memory) + entry_offsets[s]);
+        }
+    }
+    return compiled;
+#else
+    (void)program;
+    return nullptr;
+#endif
+}
+
+JitProgram::~JitProgram() {
+#ifdef JIT_X86_64
+    if (code) {
+        munmap(code, code_size);
+    }
+#endif
+}
+
+// Blocks keep y in L1 between segments. The generated loops handle an even
+// number of samples; an odd last sample goes through applyOp, which performs
+// the same arithmetic.
+void JitProgram::run(const double* x_values, double* y_values, size_t count) const {
+    for (size_t start = 0; start < count; start += kKernelBlockSize) {
+        const size_t length = std::min(kKernelBlockSize, count - start);
+        const size_t even_length = length & ~size_t(1);
+        double* block = y_values + start;
+        std::copy(x_values + start, x_values + start + length, block);
+        for (const Segment& segment : segments) {
+            if (!segment.entry) {
+                applyOp(program[segment.first_op], block, length);
+                continue;
+            }
+            segment.entry(block, block, even_length);
+            for (size_t k = segment.first_op; k < segment.first_op + segment.op_count && even_length != length; ++k) {
+                applyOp(program[k], block + even_length, 1);
+            }
+        }
+    }
+}
+
+double JitProgram::evaluateScore(const double* x_values, const double* desired_output, size_t count, const SeriesLayout* series) const {
+    std::vector<ErrorSums> sums(series ? series->getSeriesCount() : 1);
+    double block[kKernelBlockSize];
+    for (size_t start = 0; start < count; start += kKernelBlockSize) {
+        const size_t length = std::min(kKernelBlockSize, count - start);
+        run(x_values + start, block, length);
+        if (series) {
+            accumulateSeriesError(block, desired_output + start, start, length, *series, sums.data());
+        } else {
+            accumulateError(block, desired_output + start, length, sums[0]);
+        }
+    }
+    return series ? seriesSimilarityScore(sums.data(), *series) : similarityScore(sums[0]);
+}
+
+bool JitProgram::matchesInterpreter(std::span<const double> x_values) const {
+    std::vector<double> native(x_values.size());
+    std::vector<double> reference(x_values.size());
+    run(x_values.data(), native.data(), x_values.size());
+    evaluateProgram(program, x_values.data(), reference.data(), x_values.size());
+    for (size_t i = 0; i < x_values.size(); ++i) {
+        const bool both_nan = std::isnan(native[i]) && std::isnan(reference[i]);
+        if (!both_nan && std::memcmp(&native[i], &reference[i], sizeof(double)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+JitCache::JitCache(size_t min_uses, size_t min_samples, size_t capacity, bool verify)
+    : min_uses(std::max<size_t>(min_uses, 1)), min_samples(min_samples), capacity(capacity), verify(verify) {}
+
+std::shared_ptr<const JitProgram> JitCache::acquire(const Program& program, std::span<const double> x_values) {
+    const uint64_t hash = hashProgram(program, 0);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(hash);
+    if (found == entries.end()) {
+        if (entries.size() >= capacity) {
+            entries.clear();
+        }
+        found = entries.emplace(hash, Entry{program, 0, false, nullptr}).first;
+    }
+    Entry& entry = found->second;
+    // A hash collision with a different program is simply never compiled.
+    if (entry.rejected || !sameProgram(entry.program, program)) {
+        return nullptr;
+    }
+    if (entry.code) {
+        return entry.code;
+    }
+    ++entry.uses;
+    if (entry.uses < min_uses && x_values.size() < min_samples) {
+        return nullptr;
+    }
+    std::shared_ptr<const JitProgram> code = JitProgram::compile(program);
+    if (!code || (verify && !code->matchesInterpreter(x_values))) {
+        mismatch_count += code ? 1 : 0;
+        entry.rejected = true;
+        return nullptr;
+    }
+    ++compiled_count;
+    entry.code = code;
+    return code;
+}
+
+size_t JitCache::getCompiledCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return compiled_count;
+}
+
+size_t JitCache::getMismatchCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return mismatch_count;
+}
@@ -0,0 +1,364 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "kernel.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define KERNEL_SIMD 1
+#endif
+
+namespace {
+
+inline double applyScalar(OpCode code, double operand, double y) {
+    switch (code) {
+        case OpCode::Add: return y + operand;
+        case OpCode::Sub: return y - operand;
+        case OpCode::Mul: return y * operand;
+        case OpCode::Div: return y / operand;
+        case OpCode::Pow: return std::pow(y, operand);
+        case OpCode::Ln: return (y > 0) ? std::log(y) : NAN;
+        case OpCode::Sin: return std::sin(y);
+        case OpCode::Cos: return std::cos(y);
+        case OpCode::Set: return operand;
+    }
+    return y;
+}
+
+#ifdef KERNEL_SIMD
+
+bool isSmallIntegralExponent(double exponent) {
+    return exponent == std::trunc(exponent) && std::fabs(exponent) <= 4.0;
+}
+
+#define KERNEL_INLINE inline __attribute__((always_inline))
+
+// The lane helpers are always inlined into the target clones below, so the
+// 32-byte vector calling convention never crosses a function boundary.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+typedef double v4d __attribute__((vector_size(32)));
+typedef long long v4i __attribute__((vector_size(32)));
+constexpr size_t kLanes = 4;
+
+KERNEL_INLINE v4d load(const double* p) {
+    v4d v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+KERNEL_INLINE void store(double* p, const v4d& v) {
+    std::memcpy(p, &v, sizeof(v));
+}
+
+KERNEL_INLINE v4d splat(double d) {
+    return v4d{d, d, d, d};
+}
+
+KERNEL_INLINE v4i asBits(const v4d& v) {
+    return (v4i)v;
+}
+
+KERNEL_INLINE v4d asDouble(const v4i& v) {
+    return (v4d)v;
+}
+
+KERNEL_INLINE v4d select(const v4i& mask, const v4d& a, const v4d& b) {
+    return asDouble((asBits(a) & mask) | (asBits(b) & ~mask));
+}
+
+KERNEL_INLINE v4d vabs(const v4d& v) {
+    return asDouble(asBits(v) & 0x7fffffffffffffffLL);
+}
+
+KERNEL_INLINE bool anyLane(const v4i& mask) {
+    return (mask[0] | mask[1] | mask[2] | mask[3]) != 0;
+}
+
+// ln(m) for m in [sqrt(1/2), sqrt(2)] via 2 * atanh(s), s = (m - 1) / (m + 1),
+// plus the binary exponent times a two-part ln(2).
+KERNEL_INLINE v4d vlog(const v4d& y) {
+    const v4i subnormal = y < splat(2.2250738585072014e-308);
+    const v4i bits = asBits(select(subnormal, y * 0x1p54, y));
+    v4i exponent = ((bits >> 52) & 0x7ff) - 1023 - (subnormal & 54);
+    v4d m = asDouble((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+    const v4i high = m > splat(1.4142135623730951);
+    m = select(high, m * 0.5, m);
+    exponent -= high;
+    const v4d e = asDouble(exponent + 0x4338000000000000LL) - 0x1.8p52;
+
+    const v4d s = (m - 1.0) / (m + 1.0);
+    const v4d z = s * s;
+    v4d q = splat(1.0 / 23);
+    q = q * z + 1.0 / 21;
+    q = q * z + 1.0 / 19;
+    q = q * z + 1.0 / 17;
+    q = q * z + 1.0 / 15;
+    q = q * z + 1.0 / 13;
+    q = q * z + 1.0 / 11;
+    q = q * z + 1.0 / 9;
+    q = q * z + 1.0 / 7;
+    q = q * z + 1.0 / 5;
+    q = q * z + 1.0 / 3;
+    const v4d two_s = s + s;
+    v4d result = e * 6.93147180369123816490e-01 + (two_s + (two_s * z * q + e * 1.90821492927058770002e-10));
+
+    result = select(y == splat(INFINITY), y, result);
+    return select(y > splat(0.0), result, splat(NAN));
+}
+
+// sin(y + quadrant * pi / 2) with a three-part Cody-Waite reduction to
+// [-pi/4, pi/4] and the fdlibm kernel polynomials.
+KERNEL_INLINE v4d vsin(const v4d& y, long long quadrant) {
+    const v4d shifted = y * 6.36619772367581382433e-01 + 0x1.8p52;
+    const v4d k = shifted - 0x1.8p52;
+    const v4i q = (asBits(shifted) + quadrant) & 3;
+    v4d r = y - k * 1.57079632673412561417e+00;
+    r = r - k * 6.07710050630396597660e-11;
+    r = r - k * 2.02226624879595063154e-21;
+
+    const v4d z = r * r;
+    v4d ps = splat(1.58969099521155010221e-10);
+    ps = ps * z - 2.50507602534068634195e-08;
+    ps = ps * z + 2.75573137070700676789e-06;
+    ps = ps * z - 1.98412698298579493134e-04;
+    ps = ps * z + 8.33333333332248946124e-03;
+    ps = ps * z - 1.66666666666666324348e-01;
+    const v4d sin_r = r + r * z * ps;
+
+    v4d pc = splat(-1.13596475577881948265e-11);
+    pc = pc * z + 2.08757232129817482790e-09;
+    pc = pc * z - 2.75573143513906633035e-07;
+    pc = pc * z + 2.48015872894767294178e-05;
+    pc = pc * z - 1.38888888888741095749e-03;
+    pc = pc * z + 4.16666666666666019037e-02;
+    const v4d half_z = z * 0.5;
+    const v4d w = 1.0 - half_z;
+    const v4d cos_r = w + (((1.0 - w) - half_z) + z * z * pc);
+
+    v4d value = select((q & 1) != 0, cos_r, sin_r);
+    return select((q & 2) != 0, -value, value);
+}
+
+KERNEL_INLINE v4d vpow(const v4d& y, unsigned exponent, bool reciprocal) {
+    v4d result = splat(1.0);
+    v4d base = y;
+    while (exponent != 0) {
+        if (exponent & 1) {
+            result *= base;
+        }
+        exponent >>= 1;
+        if (exponent != 0) {
+            base *= base;
+        }
+    }
+    return reciprocal ? 1.0 / result : result;
+}
+
+KERNEL_INLINE v4d applyLanes(OpCode code, double operand, const v4d& y) {
+    switch (code) {
+        case OpCode::Add: return y + operand;
+        case OpCode::Sub: return y - operand;
+        case OpCode::Mul: return y * operand;
+        case OpCode::Div: return y / operand;
+        case OpCode::Pow: return vpow(y, static_cast<unsigned>(std::fabs(operand)), operand < 0);
+        case OpCode::Ln: return vlog(y);
+        case OpCode::Sin:
+        case OpCode::Cos: {
+            v4d result = vsin(y, code == OpCode::Cos ? 1 : 0);
+            const v4i large = ~(vabs(y) <= 1e6);
+            if (anyLane(large)) {
+                for (size_t lane = 0; lane < kLanes; ++lane) {
+                    if (large[lane]) {
+                        result[lane] = applyScalar(code, operand, y[lane]);
+                    }
+                }
+            }
+            return result;
+        }
+        case OpCode::Set: return splat(operand);
+    }
+    return y;
+}
+
+KERNEL_INLINE void applyRow(OpCode code, double operand, double* y_values, size_t count) {
+    if (code == OpCode::Pow && !isSmallIntegralExponent(operand)) {
+        for (size_t i = 0; i < count; ++i) {
+            y_values[i] = applyScalar(code, operand, y_values[i]);
+        }
+        return;
+    }
+    size_t i = 0;
+    for (; i + kLanes <= count; i += kLanes) {
+        store(y_values + i, applyLanes(code, operand, load(y_values + i)));
+    }
+    if (i < count) {
+        double tail[kLanes] = {1.0, 1.0, 1.0, 1.0};
+        std::copy(y_values + i, y_values + count, tail);
+        store(tail, applyLanes(code, operand, load(tail)));
+        std::copy(tail, tail + (count - i), y_values + i);
+    }
+}
+
+__attribute__((target_clones("avx2", "default")))
+void applyOpLanes(OpCode code, double operand, double* y_values, size_t count) {
+    applyRow(code, operand, y_values, count);
+}
+
+__attribute__((target_clones("avx2", "default")))
+void applyOpRowsLanes(OpCode code, const double* operands, double* rows, size_t row_count, size_t row_stride, size_t count) {
+    for (size_t row = 0; row < row_count; ++row) {
+        applyRow(code, operands[row], rows + row * row_stride, count);
+    }
+}
+
+__attribute__((target_clones("avx2", "default")))
+void accumulateLanes(const double* y_values, const double* desired_output, size_t count, double& squared, double& absolute) {
+    v4d squared_lanes = splat(0.0);
+    v4d absolute_lanes = splat(0.0);
+    size_t i = 0;
+    for (; i + kLanes <= count; i += kLanes) {
+        const v4d diff = load(y_values + i) - load(desired_output + i);
+        squared_lanes += diff * diff;
+        absolute_lanes += vabs(diff);
+    }
+    double squared_sum = (squared_lanes[0] + squared_lanes[1]) + (squared_lanes[2] + squared_lanes[3]);
+    double absolute_sum = (absolute_lanes[0] + absolute_lanes[1]) + (absolute_lanes[2] + absolute_lanes[3]);
+    for (; i < count; ++i) {
+        const double diff = y_values[i] - desired_output[i];
+        squared_sum += diff * diff;
+        absolute_sum += std::abs(diff);
+    }
+    squared += squared_sum;
+    absolute += absolute_sum;
+}
+
+#endif // KERNEL_SIMD
+
+} // namespace
+
+void applyOp(const Op& op, double* y_values, size_t count) {
+#ifdef KERNEL_SIMD
+    applyOpLanes(op.code, op.operand, y_values, count);
+#else
+    for (size_t i = 0; i < count; ++i) {
+        y_values[i] = applyScalar(op.code, op.operand, y_values[i]);
+    }
+#endif
+}
+
+void applyOpRows(OpCode code, const double* operands, double* rows, size_t row_count, size_t row_stride, size_t count) {
+#ifdef KERNEL_SIMD
+    applyOpRowsLanes(code, operands, rows, row_count, row_stride, count);
+#else
+    for (size_t row = 0; row < row_count; ++row) {
+        applyOp({code, operands[row]}, rows + row * row_stride, count);
+    }
+#endif
+}
+
+void evaluateProgram(const Program& program, const double* x_values, double* y_values, size_t count) {
+    for (size_t start = 0; start < count; start += kKernelBlockSize) {
+        const size_t length = std::min(kKernelBlockSize, count - start);
+        std::copy(x_values + start, x_values + start + length, y_values + start);
+        for (const Op& op : program) {
+            applyOp(op, y_values + start, length);
+        }
+    }
+}
+
+void accumulateError(const double* y_values, const double* desired_output, size_t count, ErrorSums& sums) {
+#ifdef KERNEL_SIMD
+    accumulateLanes(y_values, desired_output, count, sums.squared, sums.absolute);
+#else
+    for (size_t i = 0; i < count; ++i) {
+        const double diff = y_values[i] - desired_output[i];
+        sums.squared += diff * diff;
+        sums.absolute += std::abs(diff);
+    }
+#endif
+    sums.count += count;
+}
+
+ErrorSums evaluateProgramError(const Program& program, const double* x_values, const double* desired_output, size_t count) {
+    ErrorSums sums;
+    double block[kKernelBlockSize];
+    for (size_t start = 0; start < count; start += kKernelBlockSize) {
+        const size_t length = std::min(kKernelBlockSize, count - start);
+        std::copy(x_values + start, x_values + start + length, block);
+        for (const Op& op : program) {
+            applyOp(op, block, length);
+        }
+        accumulateError(block, desired_output + start, length, sums);
+    }
+    return sums;
+}
+
+double similarityScore(const ErrorSums& sums) {
+    double rmse = std::sqrt(sums.squared / sums.count);
+    return 1.0 / (1.0 + rmse);
+}
+
+void accumulateSeriesError(const double* y_values, const double* desired_output, size_t first_sample, size_t count, const SeriesLayout& layout, ErrorSums* sums) {
+    const std::span<const size_t> offsets = layout.offsets;
+    size_t series = std::upper_bound(offsets.begin(), offsets.end(), first_sample) - offsets.begin() - 1;
+    size_t done = 0;
+    while (done < count && series < layout.getSeriesCount()) {
+        const size_t piece = std::min(count - done, offsets[series + 1] - (first_sample + done));
+        accumulateError(y_values + done, desired_output + done, piece, sums[series]);
+        done += piece;
+        ++series;
+    }
+}
+
+double seriesSimilarityScore(const ErrorSums* sums, const SeriesLayout& layout) {
+    const size_t series_count = layout.getSeriesCount();
+    double combined = 0.0;
+    double total_weight = 0.0;
+    for (size_t s = 0; s < series_count; ++s) {
+        const double rmse = std::sqrt(sums[s].squared / sums[s].count);
+        switch (layout.aggregate) {
+            case SeriesAggregate::Mean:
+                combined += rmse;
+                total_weight += 1.0;
+                break;
+            case SeriesAggregate::Max:
+                // A NaN RMSE wins so an undefined series is never hidden.
+                if (s == 0 || std::isnan(rmse) || rmse > combined) {
+                    combined = rmse;
+                }
+                total_weight = 1.0;
+                break;
+            case SeriesAggregate::Weighted:
+                combined += layout.weights[s] * rmse;
+                total_weight += layout.weights[s];
+                break;
+        }
+    }
+    return 1.0 / (1.0 + combined / total_weight);
+}
+
+double evaluateProgramScore(const Program& program, const double* x_values, const double* desired_output, size_t count, const SeriesLayout* series) {
+    if (!series) {
+        return similarityScore(evaluateProgramError(program, x_values, desired_output, count));
+    }
+    std::vector<ErrorSums> sums(series->getSeriesCount());
+    double block[kKernelBlockSize];
+    for (size_t start = 0; start < count; start += kKernelBlockSize) {
+        const size_t length = std::min(kKernelBlockSize, count - start);
+        std::copy(x_values + start, x_values + start + length, block);
+        for (const Op& op : program) {
+            applyOp(op, block, length);
+        }
+        accumulateSeriesError(block, desired_output + start, start, length, *series, sums.data());
+    }
+    return seriesSimilarityScore(sums.data(), *series);
+}
+
+const char* kernelInstructionSet() {
+#ifdef KERNEL_SIMD
+    return __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
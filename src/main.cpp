@@ -1,33 +1,32 @@
 #include <iostream>
-#include <filesystem>
+#include <memory>
+#include <stdexcept>
 #include <vector>
 #include <string>
-#include <algorithm>
-#include "geneticalgo.h"
+#include "batchfitter.h"
 #include "detectobject.h"
+#include "trackstore.h"
 
-namespace fs = std::filesystem;
-
-std::vector<std::string> getImagePaths(const std::string& folder_path) {
-    if (!fs::exists(folder_path)) {
-        throw std::invalid_argument("The folder path " + folder_path + " does not exist.");
-    }
-
-    std::vector<std::string> image_files;
-    for (const auto& entry : fs::directory_iterator(folder_path)) {
-        if (entry.is_regular_file()) {
-            auto path = entry.path().string();
-            if (path.ends_with(".jpg") || path.ends_with(".png") || path.ends_with(".jpeg")) {
-                image_files.push_back(path);
+// --detection-cache PATH keeps detection results between runs;
+// --rebuild-cache discards that file's entries and detects every frame again.
+int main(int argc, char** argv) {
+    try {
+        std::string cache_path;
+        bool rebuild_cache = false;
+        for (int i = 1; i < argc; ++i) {
+            const std::string argument = argv[i];
+            if (argument == "--detection-cache") {
+                if (i + 1 == argc) {
+                    throw std::invalid_argument("--detection-cache needs a path");
+                }
+                cache_path = argv[++i];
+            } else if (argument == "--rebuild-cache") {
+                rebuild_cache = true;
+            } else {
+                throw std::invalid_argument("Unknown argument: " + argument);
             }
         }
-    }
-    std::sort(image_files.begin(), image_files.end());
-    return image_files;
-}
 
-int main() {
-    try {
         std::cout << "\nStart Running\n" << std::endl;
 
         // std::string folder_path = "<insert your video frame folder path>";
@@ -35,34 +34,38 @@ int main() {
         std::vector<std::string> image_paths = getImagePaths(folder_path);
 
         DetectObject detector;
-        auto positions_of_circles = detector.detect(image_paths, {"circle"});
-        auto [desired_output, time_sequence] = detector.rowData(positions_of_circles["circle"]);
-
-        std::vector<std::pair<std::map<std::string, std::string>, std::map<std::string, std::string>>> results;
-
-        for (size_t i = 0; i < desired_output.size(); ++i) {
-            GeneticAlgorithm row_function(time_sequence[i][0], desired_output[i][0], 5, 4);
-            Function best_row_func = row_function.run();
+        if (!cache_path.empty()) {
+            auto cache = std::make_shared<DetectionCache>(cache_path);
+            if (rebuild_cache) {
+                cache->invalidate();
+            }
+            detector.setCache(cache);
+        }
+        TrackStore tracks;
+        detector.detectTracks(image_paths, "circle", tracks);
 
-            GeneticAlgorithm col_function(time_sequence[i][1], desired_output[i][1], 5, 4);
-            Function best_col_func = col_function.run();
+        // Row and column series of every track are fitted concurrently,
+        // reading the track store in place. Neighbouring tracks tend to
+        // follow similar formulas, so the first track is fitted on its own
+        // and its survivors seed every other track's population.
+        BatchFitter fitter(5, 4);
+        std::vector<FitResult> fits;
+        if (tracks.getTrackCount() > 0) {
+            fitter.add(tracks.getT(0), tracks.getY(0));
+            fitter.add(tracks.getT(0), tracks.getX(0));
+            fits = fitter.run();
+        }
+        for (size_t i = 1; i < tracks.getTrackCount(); ++i) {
+            fitter.add(tracks.getT(i), tracks.getY(i), 0, fits[0].best_programs);
+            fitter.add(tracks.getT(i), tracks.getX(i), 0, fits[1].best_programs);
+        }
+        for (FitResult& fit : fitter.run()) {
+            fits.push_back(std::move(fit));
+        }
 
-            results.push_back(
-                {
-                    {
-                        {"best_function_expression", best_row_func.getExpression()},
-                        {"best_function_instructions", best_row_func.getInstructions().front()},
-                        {"score", std::to_string(best_row_func.evaluateSimilarity(best_row_func.calculate(time_sequence[i][0]), desired_output[i][0]))},
-                        {"track_str_infor", best_row_func.getExpression()} // Assuming track is in expression (adjust accordingly)
-                    },
-                    {
-                        {"best_function_expression", best_col_func.getExpression()},
-                        {"best_function_instructions", best_col_func.getInstructions().front()},
-                        {"score", std::to_string(best_col_func.evaluateSimilarity(best_col_func.calculate(time_sequence[i][1]), desired_output[i][1]))},
-                        {"track_str_infor", best_col_func.getExpression()} // Assuming track is in expression (adjust accordingly)
-                    }
-                }
-            );
+        std::vector<std::pair<std::map<std::string, std::string>, std::map<std::string, std::string>>> results;
+        for (size_t i = 0; i < tracks.getTrackCount(); ++i) {
+            results.push_back({fits[2 * i].summary, fits[2 * i + 1].summary});
         }
 
         // Print detailed information for each result
@@ -0,0 +1,212 @@
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include "metrics.h"
+
+namespace {
+
+std::atomic<uint64_t> next_recorder_id{1};
+
+std::string formatNumber(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+// JSON has no NaN or infinity.
+std::string jsonNumber(double value) {
+    return std::isfinite(value) ? formatNumber(value) : "null";
+}
+
+double microseconds(MetricsRecorder::Clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+} // namespace
+
+double GenerationMetrics::evaluationsPerSecond() const {
+    return evaluate_seconds > 0.0 ? evaluations / evaluate_seconds : 0.0;
+}
+
+MetricsRecorder::MetricsRecorder(size_t spans_per_thread)
+    : id(next_recorder_id.fetch_add(1, std::memory_order_relaxed)), spans_per_thread(spans_per_thread), origin(Clock::now()) {}
+
+// The last buffer used is remembered per thread, so the lock is only taken
+// when a thread first records here (or after recording to another recorder).
+MetricsRecorder::ThreadBuffer& MetricsRecorder::localBuffer() {
+    thread_local uint64_t cached_id = 0;
+    thread_local ThreadBuffer* cached = nullptr;
+    if (cached_id == id) {
+        return *cached;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::thread::id thread = std::this_thread::get_id();
+    ThreadBuffer* buffer = nullptr;
+    for (const std::unique_ptr<ThreadBuffer>& candidate : buffers) {
+        if (candidate->thread == thread) {
+            buffer = candidate.get();
+        }
+    }
+    if (!buffer) {
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = buffers.back().get();
+        buffer->thread = thread;
+        buffer->spans.reserve(spans_per_thread);
+    }
+    cached_id = id;
+    cached = buffer;
+    return *buffer;
+}
+
+void MetricsRecorder::recordSpan(const char* name, Clock::time_point start, Clock::time_point end) {
+    ThreadBuffer& buffer = localBuffer();
+    if (buffer.spans.size() < spans_per_thread) {
+        buffer.spans.push_back({name, start, end});
+    } else {
+        ++buffer.dropped;
+    }
+}
+
+void MetricsRecorder::recordGeneration(const GenerationMetrics& metrics) {
+    localBuffer().generations.push_back({metrics, Clock::now()});
+}
+
+uint64_t MetricsRecorder::nextRunId() {
+    return next_run.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<GenerationMetrics> MetricsRecorder::getGenerations() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<GenerationMetrics> generations;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+        for (const GenerationRecord& record : buffer->generations) {
+            generations.push_back(record.metrics);
+        }
+    }
+    return generations;
+}
+
+size_t MetricsRecorder::getDroppedSpans() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t dropped = 0;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+        dropped += buffer->dropped;
+    }
+    return dropped;
+}
+
+std::string MetricsRecorder::format(MetricsFormat format) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    switch (format) {
+        case MetricsFormat::Csv: return formatCsv();
+        case MetricsFormat::Json: return formatJson();
+        case MetricsFormat::ChromeTrace: return formatChromeTrace();
+    }
+    return std::string();
+}
+
+void MetricsRecorder::save(const std::string& path, MetricsFormat format) const {
+    const std::string text = this->format(format);
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        throw std::runtime_error("Could not write metrics: " + path);
+    }
+    bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (std::fclose(file) != 0 || !written) {
+        throw std::runtime_error("Could not write metrics: " + path);
+    }
+}
+
+// `thread` is the buffer's registration index; `run` identifies the GA.
+std::string MetricsRecorder::formatCsv() const {
+    std::string csv = "thread,run,generation,evaluations,evaluations_per_second,evaluate_seconds,select_seconds,refine_seconds,mutate_seconds,"
+                      "best_score,median_score,diversity,cache_hits,cache_misses,raced_out,skipped_samples,jit_compiled\n";
+    for (size_t t = 0; t < buffers.size(); ++t) {
+        for (const GenerationRecord& record : buffers[t]->generations) {
+            const GenerationMetrics& m = record.metrics;
+            csv += std::to_string(t) + "," + std::to_string(m.run) + "," + std::to_string(m.generation) + "," + std::to_string(m.evaluations) + ","
+                + formatNumber(m.evaluationsPerSecond()) + "," + formatNumber(m.evaluate_seconds) + "," + formatNumber(m.select_seconds) + ","
+                + formatNumber(m.refine_seconds) + "," + formatNumber(m.mutate_seconds) + "," + formatNumber(m.best_score) + ","
+                + formatNumber(m.median_score) + "," + formatNumber(m.diversity) + "," + std::to_string(m.cache_hits) + ","
+                + std::to_string(m.cache_misses) + "," + std::to_string(m.raced_out) + "," + std::to_string(m.skipped_samples) + ","
+                + std::to_string(m.jit_compiled) + "\n";
+        }
+    }
+    return csv;
+}
+
+std::string MetricsRecorder::formatJson() const {
+    std::string json = "{\n  \"generations\": [";
+    bool first = true;
+    for (size_t t = 0; t < buffers.size(); ++t) {
+        for (const GenerationRecord& record : buffers[t]->generations) {
+            const GenerationMetrics& m = record.metrics;
+            json += first ? "\n" : ",\n";
+            first = false;
+            json += "    {\"thread\": " + std::to_string(t) + ", \"run\": " + std::to_string(m.run) + ", \"generation\": " + std::to_string(m.generation)
+                + ", \"evaluations\": " + std::to_string(m.evaluations) + ", \"evaluations_per_second\": " + jsonNumber(m.evaluationsPerSecond())
+                + ", \"evaluate_seconds\": " + jsonNumber(m.evaluate_seconds) + ", \"select_seconds\": " + jsonNumber(m.select_seconds)
+                + ", \"refine_seconds\": " + jsonNumber(m.refine_seconds) + ", \"mutate_seconds\": " + jsonNumber(m.mutate_seconds)
+                + ", \"best_score\": " + jsonNumber(m.best_score) + ", \"median_score\": " + jsonNumber(m.median_score)
+                + ", \"diversity\": " + jsonNumber(m.diversity) + ", \"cache_hits\": " + std::to_string(m.cache_hits)
+                + ", \"cache_misses\": " + std::to_string(m.cache_misses) + ", \"raced_out\": " + std::to_string(m.raced_out)
+                + ", \"skipped_samples\": " + std::to_string(m.skipped_samples) + ", \"jit_compiled\": " + std::to_string(m.jit_compiled) + "}";
+        }
+    }
+    json += "\n  ],\n  \"spans\": [";
+    first = true;
+    for (size_t t = 0; t < buffers.size(); ++t) {
+        // Totals per span name, ordered by name.
+        std::map<std::string, std::pair<size_t, double>> totals;
+        for (const Span& span : buffers[t]->spans) {
+            std::pair<size_t, double>& total = totals[span.name];
+            ++total.first;
+            total.second += std::chrono::duration<double>(span.end - span.start).count();
+        }
+        for (const auto& [name, total] : totals) {
+            json += first ? "\n" : ",\n";
+            first = false;
+            json += "    {\"thread\": " + std::to_string(t) + ", \"name\": \"" + name + "\", \"count\": " + std::to_string(total.first)
+                + ", \"seconds\": " + jsonNumber(total.second) + "}";
+        }
+    }
+    json += "\n  ],\n  \"dropped_spans\": ";
+    size_t dropped = 0;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+        dropped += buffer->dropped;
+    }
+    json += std::to_string(dropped) + "\n}\n";
+    return json;
+}
+
+// Complete ("X") events per span and counter ("C") events per generation and
+// run, timestamps in microseconds since the recorder was created.
+std::string MetricsRecorder::formatChromeTrace() const {
+    std::string trace = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    auto append = [&](const std::string& event) {
+        trace += first ? "\n" : ",\n";
+        first = false;
+        trace += event;
+    };
+    for (size_t t = 0; t < buffers.size(); ++t) {
+        const std::string tid = std::to_string(t);
+        append("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " + tid + ", \"args\": {\"name\": \"thread " + tid + "\"}}");
+        for (const Span& span : buffers[t]->spans) {
+            append("{\"name\": \"" + std::string(span.name) + "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " + tid
+                + ", \"ts\": " + formatNumber(microseconds(span.start - origin)) + ", \"dur\": " + formatNumber(microseconds(span.end - span.start)) + "}");
+        }
+        for (const GenerationRecord& record : buffers[t]->generations) {
+            const GenerationMetrics& m = record.metrics;
+            const std::string run = std::to_string(m.run);
+            const std::string prefix = "{\"pid\": 0, \"tid\": " + tid + ", \"ph\": \"C\", \"ts\": " + formatNumber(microseconds(record.time - origin));
+            append(prefix + ", \"name\": \"score run " + run + "\", \"args\": {\"best\": " + jsonNumber(m.best_score) + ", \"median\": " + jsonNumber(m.median_score) + "}}");
+            append(prefix + ", \"name\": \"diversity run " + run + "\", \"args\": {\"diversity\": " + jsonNumber(m.diversity) + "}}");
+            append(prefix + ", \"name\": \"evaluations/s run " + run + "\", \"args\": {\"rate\": " + jsonNumber(m.evaluationsPerSecond()) + "}}");
+        }
+    }
+    trace += "\n]}\n";
+    return trace;
+}
@@ -0,0 +1,247 @@
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include "program.h"
+
+namespace {
+
+class InstructionCursor {
+public:
+    explicit InstructionCursor(std::string_view text) : text(text), pos(0) {}
+
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) {
+            ++pos;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos < text.size() && text[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeWord(std::string_view word) {
+        skipSpace();
+        if (text.substr(pos, word.size()) == word) {
+            pos += word.size();
+            return true;
+        }
+        return false;
+    }
+
+    char peek() {
+        skipSpace();
+        return pos < text.size() ? text[pos] : '\0';
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return pos == text.size();
+    }
+
+    bool number(double& value, std::string_view& token) {
+        skipSpace();
+        size_t start = pos;
+        if (start < text.size() && text[start] == '+') {
+            ++start;
+        }
+        auto result = std::from_chars(text.data() + start, text.data() + text.size(), value);
+        if (result.ec != std::errc()) {
+            return false;
+        }
+        size_t end = static_cast<size_t>(result.ptr - text.data());
+        token = text.substr(start, end - start);
+        pos = end;
+        return true;
+    }
+
+    [[noreturn]] void fail(const char* expected) const {
+        throw std::invalid_argument("Malformed instruction '" + std::string(text) + "': expected " + expected + " at position " + std::to_string(pos));
+    }
+
+private:
+    std::string_view text;
+    size_t pos;
+};
+
+} // namespace
+
+Op parseInstruction(std::string_view text, std::string& normalized) {
+    InstructionCursor cursor(text);
+    if (!cursor.consume('y')) {
+        cursor.fail("'y'");
+    }
+    if (!cursor.consume('=')) {
+        cursor.fail("'='");
+    }
+
+    Op op{OpCode::Set, 0.0};
+    std::string_view token;
+    char symbol = cursor.peek();
+    if (symbol == 'y') {
+        cursor.consume('y');
+        symbol = cursor.peek();
+        switch (symbol) {
+            case '+': op.code = OpCode::Add; break;
+            case '-': op.code = OpCode::Sub; break;
+            case '*': op.code = OpCode::Mul; break;
+            case '/': op.code = OpCode::Div; break;
+            case '^': op.code = OpCode::Pow; break;
+            default: cursor.fail("one of + - * / ^");
+        }
+        cursor.consume(symbol);
+        if (!cursor.number(op.operand, token)) {
+            cursor.fail("a number");
+        }
+    } else if (symbol == 'l' || symbol == 's' || symbol == 'c') {
+        if (cursor.consumeWord("ln")) {
+            op.code = OpCode::Ln;
+            token = "ln";
+        } else if (cursor.consumeWord("sin")) {
+            op.code = OpCode::Sin;
+            token = "sin";
+        } else if (cursor.consumeWord("cos")) {
+            op.code = OpCode::Cos;
+            token = "cos";
+        } else {
+            cursor.fail("ln, sin or cos");
+        }
+        if (!cursor.consume('(')) {
+            cursor.fail("'('");
+        }
+        if (!cursor.consume('y')) {
+            cursor.fail("'y'");
+        }
+        if (!cursor.consume(')')) {
+            cursor.fail("')'");
+        }
+    } else if (!cursor.number(op.operand, token)) {
+        cursor.fail("'y', a function or a number");
+    }
+    if (!cursor.atEnd()) {
+        cursor.fail("end of instruction");
+    }
+
+    switch (op.code) {
+        case OpCode::Add:
+        case OpCode::Sub:
+        case OpCode::Mul:
+        case OpCode::Div:
+        case OpCode::Pow:
+            normalized.assign("y = y ");
+            normalized += symbol;
+            normalized += ' ';
+            normalized.append(token);
+            break;
+        case OpCode::Ln:
+        case OpCode::Sin:
+        case OpCode::Cos:
+            normalized.assign("y = ");
+            normalized.append(token);
+            normalized.append("(y)");
+            break;
+        case OpCode::Set:
+            normalized.assign("y = ");
+            normalized.append(token);
+            break;
+    }
+    return op;
+}
+
+std::string formatInstruction(const Op& op) {
+    char number[32];
+    char* end = std::to_chars(number, number + sizeof(number), op.operand).ptr;
+    const std::string operand(number, end);
+    switch (op.code) {
+        case OpCode::Add: return "y = y + " + operand;
+        case OpCode::Sub: return "y = y - " + operand;
+        case OpCode::Mul: return "y = y * " + operand;
+        case OpCode::Div: return "y = y / " + operand;
+        case OpCode::Pow: return "y = y ^ " + operand;
+        case OpCode::Ln: return "y = ln(y)";
+        case OpCode::Sin: return "y = sin(y)";
+        case OpCode::Cos: return "y = cos(y)";
+        case OpCode::Set: return "y = " + operand;
+    }
+    return {};
+}
+
+void canonicalizeProgram(const Program& program, Program& canonical) {
+    canonical.clear();
+    for (const Op& op : program) {
+        switch (op.code) {
+            case OpCode::Set:
+                canonical.clear();
+                canonical.push_back(op);
+                break;
+            case OpCode::Add:
+            case OpCode::Sub: {
+                double value = (op.code == OpCode::Sub) ? -op.operand : op.operand;
+                if (!canonical.empty() && canonical.back().code == OpCode::Set) {
+                    canonical.back().operand += value;
+                } else if (!canonical.empty() && canonical.back().code == OpCode::Add) {
+                    canonical.back().operand += value;
+                    if (canonical.back().operand == 0.0) {
+                        canonical.pop_back();
+                    }
+                } else if (value != 0.0) {
+                    canonical.push_back({OpCode::Add, value});
+                }
+                break;
+            }
+            case OpCode::Mul:
+            case OpCode::Div: {
+                double value = (op.code == OpCode::Div) ? 1.0 / op.operand : op.operand;
+                if (!canonical.empty() && canonical.back().code == OpCode::Set) {
+                    canonical.back().operand *= value;
+                } else if (!canonical.empty() && canonical.back().code == OpCode::Mul) {
+                    canonical.back().operand *= value;
+                    if (canonical.back().operand == 1.0) {
+                        canonical.pop_back();
+                    }
+                } else if (value != 1.0) {
+                    canonical.push_back({OpCode::Mul, value});
+                }
+                break;
+            }
+            case OpCode::Pow:
+                if (op.operand != 1.0) {
+                    canonical.push_back(op);
+                }
+                break;
+            case OpCode::Ln:
+            case OpCode::Sin:
+            case OpCode::Cos:
+                canonical.push_back({op.code, 0.0});
+                break;
+        }
+    }
+}
+
+uint64_t hashProgram(const Program& program, uint64_t seed) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+    auto mix = [&hash](uint64_t value) {
+        for (int byte = 0; byte < 8; ++byte) {
+            hash ^= (value >> (byte * 8)) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+    };
+    mix(program.size());
+    for (const Op& op : program) {
+        double operand = (op.operand == 0.0) ? 0.0 : op.operand;
+        uint64_t bits;
+        std::memcpy(&bits, &operand, sizeof(bits));
+        if (std::isnan(operand)) {
+            bits = 0x7ff8000000000000ULL;
+        }
+        mix(static_cast<uint64_t>(op.code));
+        mix(bits);
+    }
+    return hash ^ (hash >> 29);
+}
@@ -0,0 +1,41 @@
+#include "rng.h"
+
+namespace {
+
+uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+} // namespace
+
+Rng::Rng(uint64_t seed, uint64_t stream) {
+    uint64_t seed_mix = seed;
+    uint64_t stream_mix = stream;
+    uint64_t stream_key = splitmix64(seed_mix) ^ rotl(splitmix64(stream_mix), 32);
+    for (uint64_t& word : state) {
+        word = splitmix64(stream_key);
+    }
+}
+
+uint64_t Rng::next() {
+    const uint64_t result = rotl(state[1] * 5, 7) * 9;
+    const uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+    return result;
+}
+
+size_t Rng::uniform(size_t bound) {
+    return static_cast<size_t>(next() % bound);
+}
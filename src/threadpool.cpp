@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <chrono>
+#include "threadpool.h"
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+void ThreadPool::TaskQueue::pushBack(const Task& task) {
+    if (size == ring.size()) {
+        std::vector<Task> grown(ring.empty() ? 64 : ring.size() * 2);
+        for (size_t i = 0; i < size; ++i) {
+            grown[i] = ring[(head + i) % ring.size()];
+        }
+        ring.swap(grown);
+        head = 0;
+    }
+    ring[(head + size) % ring.size()] = task;
+    ++size;
+}
+
+bool ThreadPool::TaskQueue::popBack(Task& task) {
+    if (size == 0) {
+        return false;
+    }
+    --size;
+    task = ring[(head + size) % ring.size()];
+    return true;
+}
+
+bool ThreadPool::TaskQueue::popFront(Task& task) {
+    if (size == 0) {
+        return false;
+    }
+    task = ring[head];
+    head = (head + 1) % ring.size();
+    --size;
+    return true;
+}
+
+ThreadPool::ThreadPool(size_t worker_count) {
+    for (size_t i = 0; i < worker_count; ++i) {
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::getWorkerCount() const {
+    return workers.size();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (workers.empty()) {
+        runSubmitted(task);
+        return;
+    }
+    push({nullptr, 0, 0, new std::function<void()>(std::move(task))});
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    wake.notify_one();
+}
+
+std::exception_ptr ThreadPool::takeSubmitError() {
+    std::lock_guard<std::mutex> lock(submit_error_mutex);
+    std::exception_ptr error = submit_error;
+    submit_error = nullptr;
+    return error;
+}
+
+// An escaping exception would terminate the worker, and with it the process.
+void ThreadPool::runSubmitted(std::function<void()>& function) {
+    try {
+        function();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(submit_error_mutex);
+        if (!submit_error) {
+            submit_error = std::current_exception();
+        }
+    }
+}
+
+void ThreadPool::run(Job& job, size_t count, size_t grain) {
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    const size_t chunks = (count + grain - 1) / grain;
+    if (workers.empty() || chunks == 1) {
+        for (size_t begin = 0; begin < count; begin += grain) {
+            job.invoke(job.context, begin, std::min(count, begin + grain));
+        }
+        return;
+    }
+
+    job.remaining.store(chunks);
+    for (size_t begin = 0; begin < count; begin += grain) {
+        push({&job, begin, std::min(count, begin + grain), nullptr});
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+    }
+    wake.notify_all();
+
+    while (job.remaining.load(std::memory_order_acquire) != 0) {
+        if (tryRunOne()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.done.wait_for(lock, std::chrono::microseconds(200), [&job] {
+            return job.remaining.load(std::memory_order_acquire) == 0;
+        });
+    }
+    // The last chunk decrements under job.mutex; taking it here guarantees that
+    // thread is done touching the job before it goes out of scope.
+    std::lock_guard<std::mutex> lock(job.mutex);
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+void ThreadPool::push(const Task& task) {
+    size_t index;
+    if (current_pool == this) {
+        index = current_worker;
+    } else {
+        index = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    }
+    pending.fetch_add(1, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(queues[index]->mutex);
+    queues[index]->pushBack(task);
+}
+
+bool ThreadPool::tryRunOne() {
+    if (pending.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    Task task;
+    bool found = false;
+    const size_t own = (current_pool == this) ? current_worker : 0;
+    if (current_pool == this) {
+        std::lock_guard<std::mutex> lock(queues[own]->mutex);
+        found = queues[own]->popBack(task);
+    }
+    for (size_t offset = 1; !found && offset <= queues.size(); ++offset) {
+        TaskQueue& victim = *queues[(own + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        found = victim.popFront(task);
+    }
+    if (!found) {
+        return false;
+    }
+    pending.fetch_sub(1, std::memory_order_acq_rel);
+    execute(task);
+    return true;
+}
+
+void ThreadPool::execute(Task& task) {
+    if (task.function) {
+        std::unique_ptr<std::function<void()>> function(task.function);
+        runSubmitted(*function);
+        return;
+    }
+    Job& job = *task.job;
+    try {
+        job.invoke(job.context, task.begin, task.end);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        if (!job.error) {
+            job.error = std::current_exception();
+        }
+    }
+    std::lock_guard<std::mutex> lock(job.mutex);
+    if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        job.done.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    while (true) {
+        if (tryRunOne()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait(lock, [this] {
+            return stopping || pending.load(std::memory_order_acquire) != 0;
+        });
+        if (stopping && pending.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
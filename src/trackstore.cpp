@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <stdexcept>
+#include "trackstore.h"
+
+TrackStore::TrackStore(double max_distance, size_t max_gap) : max_distance(max_distance), max_gap(max_gap) {}
+
+void TrackStore::appendFrame(double t, std::span<const std::pair<int, int>> positions) {
+    if (finished) {
+        throw std::logic_error("TrackStore::appendFrame called after finish()");
+    }
+    const size_t frame = frame_count++;
+    open_tracks.erase(std::remove_if(open_tracks.begin(), open_tracks.end(), [&](const OpenTrack& track) {
+        return frame - track.last_frame > max_gap + 1;
+    }), open_tracks.end());
+
+    // Closest pairs are matched first, each track and detection at most once.
+    candidates.clear();
+    for (size_t o = 0; o < open_tracks.size(); ++o) {
+        for (size_t p = 0; p < positions.size(); ++p) {
+            double dx = positions[p].first - open_tracks[o].x;
+            double dy = positions[p].second - open_tracks[o].y;
+            double distance = dx * dx + dy * dy;
+            if (distance <= max_distance * max_distance) {
+                candidates.emplace_back(distance, o, p);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    assigned.assign(positions.size(), UINT32_MAX);
+    track_taken.assign(open_tracks.size(), false);
+    for (const auto& [distance, o, p] : candidates) {
+        if (track_taken[o] || assigned[p] != UINT32_MAX) {
+            continue;
+        }
+        track_taken[o] = true;
+        assigned[p] = open_tracks[o].id;
+        open_tracks[o].last_frame = frame;
+        open_tracks[o].x = positions[p].first;
+        open_tracks[o].y = positions[p].second;
+    }
+
+    for (size_t p = 0; p < positions.size(); ++p) {
+        if (assigned[p] == UINT32_MAX) {
+            assigned[p] = static_cast<uint32_t>(track_count++);
+            open_tracks.push_back({assigned[p], frame, static_cast<double>(positions[p].first), static_cast<double>(positions[p].second)});
+        }
+        t_values.push_back(t);
+        x_values.push_back(positions[p].first);
+        y_values.push_back(positions[p].second);
+        track_ids.push_back(assigned[p]);
+    }
+}
+
+void TrackStore::finish() {
+    if (finished) {
+        return;
+    }
+    // Counting sort by track id; within a track samples stay in time order.
+    offsets.assign(track_count + 1, 0);
+    for (uint32_t id : track_ids) {
+        ++offsets[id + 1];
+    }
+    for (size_t i = 0; i < track_count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    std::vector<double> grouped_t(t_values.size());
+    std::vector<double> grouped_x(x_values.size());
+    std::vector<double> grouped_y(y_values.size());
+    for (size_t row = 0; row < track_ids.size(); ++row) {
+        size_t target = cursor[track_ids[row]]++;
+        grouped_t[target] = t_values[row];
+        grouped_x[target] = x_values[row];
+        grouped_y[target] = y_values[row];
+    }
+    t_values.swap(grouped_t);
+    x_values.swap(grouped_x);
+    y_values.swap(grouped_y);
+    track_ids.clear();
+    track_ids.shrink_to_fit();
+    open_tracks.clear();
+    finished = true;
+}
+
+void TrackStore::clear() {
+    t_values.clear();
+    x_values.clear();
+    y_values.clear();
+    track_ids.clear();
+    offsets.clear();
+    open_tracks.clear();
+    frame_count = 0;
+    track_count = 0;
+    finished = false;
+}
+
+size_t TrackStore::getTrackCount() const {
+    return track_count;
+}
+
+size_t TrackStore::getSampleCount() const {
+    return t_values.size();
+}
+
+std::span<const double> TrackStore::getT(size_t track) const {
+    return column(t_values, track);
+}
+
+std::span<const double> TrackStore::getX(size_t track) const {
+    return column(x_values, track);
+}
+
+std::span<const double> TrackStore::getY(size_t track) const {
+    return column(y_values, track);
+}
+
+std::span<const double> TrackStore::column(const std::vector<double>& values, size_t track) const {
+    if (!finished) {
+        throw std::logic_error("TrackStore columns are only grouped after finish()");
+    }
+    if (track >= track_count) {
+        throw std::out_of_range("TrackStore track index out of range");
+    }
+    return std::span<const double>(values.data() + offsets[track], offsets[track + 1] - offsets[track]);
+}
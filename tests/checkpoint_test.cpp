@@ -0,0 +1,135 @@
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "checkpoint.h"
+#include "geneticalgo.h"
+
+// Round trip of saveCheckpoint/loadCheckpoint/restore: a run resumed from a
+// checkpoint must end exactly where the uninterrupted run does.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+template <typename Body>
+bool throwsError(Body body) {
+    try {
+        body();
+    } catch (const std::exception&) {
+        return true;
+    }
+    return false;
+}
+
+std::string summary(GeneticAlgorithm& ga) {
+    char score[32];
+    std::snprintf(score, sizeof(score), "%.17g", ga.getBestScore());
+    std::string text = score;
+    for (const Function& function : ga.getTopIndividuals(8)) {
+        text += " | " + function.getExpression();
+    }
+    return text;
+}
+
+bool samePrograms(const std::vector<Program>& a, const std::vector<Program>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].size() != b[i].size()) {
+            return false;
+        }
+        for (size_t k = 0; k < a[i].size(); ++k) {
+            if (a[i][k].code != b[i][k].code || a[i][k].operand != b[i][k].operand) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const std::string path = "checkpoint_test.bin";
+    std::vector<double> x_values;
+    std::vector<double> desired;
+    for (int i = 0; i < 1000; ++i) {
+        x_values.push_back(0.5 + i * 0.01);
+        desired.push_back(2.0 * std::sin(x_values.back()) + 0.3 * x_values.back());
+    }
+    std::span<const double> x(x_values);
+    std::span<const double> d(desired);
+
+    const int generations = 20;
+    for (int variant = 0; variant < 6; ++variant) {
+        GeneticAlgorithmOptions options;
+        options.seed = 11 + variant;
+        options.thread_count = 1 + variant % 2;
+        options.racing = variant & 1;
+        options.refine_count = (variant & 2) ? 2 : 0;
+        options.incremental_evaluation = variant == 4;
+        options.jit = variant == 5;
+        options.jit_min_uses = 2;
+        const int population = (variant == 3) ? 41 : 50;
+        const std::string name = "variant " + std::to_string(variant);
+
+        GeneticAlgorithm uninterrupted(x, d, population, generations, options);
+        uninterrupted.initialize();
+        while (uninterrupted.getGeneration() < generations) {
+            uninterrupted.step();
+        }
+
+        GeneticAlgorithm interrupted(x, d, population, generations, options);
+        interrupted.initialize();
+        for (int g = 0; g < 8; ++g) {
+            interrupted.step();
+        }
+        GaCheckpoint saved = interrupted.checkpoint();
+        saveCheckpoint(path, saved);
+        GaCheckpoint loaded = loadCheckpoint(path);
+        check(loaded.seed == saved.seed && loaded.generation == saved.generation && loaded.survivor_count == saved.survivor_count
+            && loaded.best_score == saved.best_score && loaded.scores == saved.scores && samePrograms(loaded.programs, saved.programs), name + ": file round trip");
+
+        GeneticAlgorithmOptions other_options = options;
+        other_options.seed = 999;
+        GeneticAlgorithm resumed(x, d, population, generations, other_options);
+        resumed.restore(loaded);
+        while (resumed.getGeneration() < generations) {
+            resumed.step();
+        }
+        check(summary(resumed) == summary(uninterrupted), name + ": resumed run matches the uninterrupted one");
+    }
+
+    GeneticAlgorithm ga(x, d, 50, generations);
+    ga.initialize();
+    ga.step();
+    GaCheckpoint empty_program = ga.checkpoint();
+    empty_program.programs[3].clear();
+    check(throwsError([&] { ga.restore(empty_program); }), "restore rejects an empty program");
+    saveCheckpoint(path, empty_program);
+    check(throwsError([&] { loadCheckpoint(path); }), "loadCheckpoint rejects an empty program");
+
+    GaCheckpoint short_population = ga.checkpoint();
+    short_population.programs.pop_back();
+    short_population.scores.pop_back();
+    check(throwsError([&] { ga.restore(short_population); }), "restore rejects a population of the wrong size");
+    GaCheckpoint missing_scores = ga.checkpoint();
+    missing_scores.scores.pop_back();
+    check(throwsError([&] { ga.restore(missing_scores); }), "restore rejects missing scores");
+
+    std::remove(path.c_str());
+    if (failures == 0) {
+        std::printf("checkpoint_test passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
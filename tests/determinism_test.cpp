@@ -0,0 +1,91 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "geneticalgo.h"
+
+// A run's results depend only on its seed: the same seed must give
+// bit-identical survivors and scores at every thread count.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+bool sameBits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+bool sameIndividuals(const std::vector<Function>& a, const std::vector<Function>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        const Program& pa = a[i].getProgram();
+        const Program& pb = b[i].getProgram();
+        if (!sameBits(a[i].getScore(), b[i].getScore()) || pa.size() != pb.size()) {
+            return false;
+        }
+        for (size_t k = 0; k < pa.size(); ++k) {
+            if (pa[k].code != pb[k].code || !sameBits(pa[k].operand, pb[k].operand)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    std::vector<double> x_values;
+    std::vector<double> desired;
+    for (int i = 0; i < 3000; ++i) {
+        x_values.push_back(0.5 + i * 0.003);
+        desired.push_back(2.0 * std::sin(x_values.back()) + 0.3 * x_values.back());
+    }
+    std::span<const double> x(x_values);
+    std::span<const double> d(desired);
+
+    const int population = 120;
+    const int generations = 15;
+    for (int variant = 0; variant < 6; ++variant) {
+        GeneticAlgorithmOptions options;
+        options.seed = 3 + variant;
+        options.racing = variant == 1;
+        options.refine_count = (variant == 2) ? 3 : 0;
+        options.cache_capacity = (variant == 3) ? 4096 : 0;
+        options.incremental_evaluation = variant == 4;
+        options.jit = variant == 5;
+        options.jit_min_uses = 2;
+        const std::string name = "variant " + std::to_string(variant);
+
+        options.thread_count = 1;
+        GeneticAlgorithm serial(x, d, population, generations, options);
+        options.thread_count = 4;
+        GeneticAlgorithm parallel(x, d, population, generations, options);
+        serial.initialize();
+        parallel.initialize();
+        bool identical = true;
+        for (int generation = 0; generation < generations && identical; ++generation) {
+            serial.step();
+            parallel.step();
+            identical = sameBits(serial.getBestScore(), parallel.getBestScore())
+                && sameIndividuals(serial.getTopIndividuals(population), parallel.getTopIndividuals(population));
+            check(identical, name + ": 1 and 4 threads agree after generation " + std::to_string(generation));
+        }
+        check(serial.getBestFunction().getExpression() == parallel.getBestFunction().getExpression(), name + ": best functions agree");
+    }
+
+    if (failures == 0) {
+        std::printf("determinism_test passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "jit.h"
+#include "kernel.h"
+
+// Native code must produce exactly what the interpreter kernel does, output
+// and score, on any program and any sample count.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// Bit for bit, except that any two NaNs are equal.
+bool sameValue(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0 || (std::isnan(a) && std::isnan(b));
+}
+
+Program randomProgram(std::mt19937_64& rng, size_t length) {
+    static const OpCode codes[] = {OpCode::Add, OpCode::Sub, OpCode::Mul, OpCode::Div, OpCode::Pow, OpCode::Ln, OpCode::Sin, OpCode::Cos, OpCode::Set};
+    static const double operands[] = {0.0, 1.0, -1.0, 2.0, 0.5, -3.0, 4.0, 1.5, 1e-3, 7.25, 1e300};
+    std::uniform_int_distribution<size_t> code(0, std::size(codes) - 1);
+    std::uniform_int_distribution<size_t> operand(0, std::size(operands) - 1);
+    Program program;
+    for (size_t k = 0; k < length; ++k) {
+        program.push_back({codes[code(rng)], operands[operand(rng)]});
+    }
+    return program;
+}
+
+} // namespace
+
+int main() {
+    if (!JitProgram::compile({{OpCode::Add, 1.0}})) {
+        std::printf("jit_test skipped: no native code on this platform\n");
+        return 0;
+    }
+
+    std::mt19937_64 rng(99);
+    std::uniform_real_distribution<double> spread(-50.0, 50.0);
+    // Odd and block-straddling counts exercise the scalar tails.
+    for (size_t count : {1, 3, 255, 256, 257, 1001}) {
+        std::vector<double> x_values(count);
+        std::vector<double> desired(count);
+        for (size_t i = 0; i < count; ++i) {
+            x_values[i] = (i % 17 == 0) ? 0.0 : spread(rng);
+            desired[i] = std::sin(x_values[i]);
+        }
+        for (int trial = 0; trial < 200; ++trial) {
+            const Program program = (trial < 100) ? randomProgram(rng, 1 + trial % 12) : randomProgram(rng, 1 + trial % 40);
+            std::unique_ptr<JitProgram> native = JitProgram::compile(program);
+            const std::string name = std::to_string(count) + " samples, trial " + std::to_string(trial);
+            check(native != nullptr, name + ": compiles");
+            if (!native) {
+                continue;
+            }
+            std::vector<double> expected(count);
+            std::vector<double> actual(count);
+            evaluateProgram(program, x_values.data(), expected.data(), count);
+            native->run(x_values.data(), actual.data(), count);
+            bool identical = true;
+            for (size_t i = 0; i < count; ++i) {
+                identical = identical && sameValue(expected[i], actual[i]);
+            }
+            check(identical, name + ": output matches evaluateProgram");
+            check(sameValue(native->evaluateScore(x_values.data(), desired.data(), count, nullptr),
+                            evaluateProgramScore(program, x_values.data(), desired.data(), count, nullptr)),
+                  name + ": score matches evaluateProgramScore");
+        }
+    }
+
+    if (failures == 0) {
+        std::printf("jit_test passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
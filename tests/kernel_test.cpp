@@ -0,0 +1,114 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "kernel.h"
+
+// Accuracy of the vectorized ln, sin, cos and small integral powers against
+// libm, over the ranges kernel.h documents.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// Doubles mapped to integers that are consecutive for consecutive doubles.
+int64_t ordered(double value) {
+    int64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? INT64_MIN - bits : bits;
+}
+
+uint64_t ulpDistance(double a, double b) {
+    if (a == b || (std::isnan(a) && std::isnan(b))) {
+        return 0;
+    }
+    if (std::isnan(a) || std::isnan(b)) {
+        return UINT64_MAX;
+    }
+    int64_t difference = ordered(a) - ordered(b);
+    return difference < 0 ? static_cast<uint64_t>(-difference) : static_cast<uint64_t>(difference);
+}
+
+// Largest distance between applyOp and `reference` over `inputs`.
+template <typename Reference>
+uint64_t worstUlp(const Op& op, const std::vector<double>& inputs, Reference reference) {
+    std::vector<double> values = inputs;
+    applyOp(op, values.data(), values.size());
+    uint64_t worst = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        worst = std::max(worst, ulpDistance(values[i], reference(inputs[i])));
+    }
+    return worst;
+}
+
+// exp of uniform exponents in [low, high], each with a random sign when
+// `signed_values` is set.
+std::vector<double> logUniform(std::mt19937_64& rng, double low, double high, bool signed_values) {
+    std::uniform_real_distribution<double> exponent(low, high);
+    std::vector<double> values(1 << 16);
+    for (double& value : values) {
+        value = std::exp(exponent(rng));
+        if (signed_values && (rng() & 1)) {
+            value = -value;
+        }
+    }
+    return values;
+}
+
+std::vector<double> uniform(std::mt19937_64& rng, double low, double high) {
+    std::uniform_real_distribution<double> distribution(low, high);
+    std::vector<double> values(1 << 16);
+    for (double& value : values) {
+        value = distribution(rng);
+    }
+    return values;
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng(42);
+
+    // Down to the smallest subnormal and up to the largest finite double.
+    std::vector<double> positive = logUniform(rng, -744.0, 709.7, false);
+    positive.push_back(4.9e-324);
+    positive.push_back(1.0);
+    positive.push_back(1.7976931348623157e308);
+    check(worstUlp({OpCode::Ln, 0.0}, positive, [](double y) { return std::log(y); }) <= 2, "ln within 2 ulp");
+    std::vector<double> non_positive = {0.0, -0.0, -1.0, -1e300};
+    check(worstUlp({OpCode::Ln, 0.0}, non_positive, [](double) { return NAN; }) == 0, "ln of non-positive inputs is NaN");
+
+    for (const std::vector<double>& inputs : {uniform(rng, -10.0, 10.0), uniform(rng, -1e6, 1e6)}) {
+        check(worstUlp({OpCode::Sin, 0.0}, inputs, [](double y) { return std::sin(y); }) <= 2, "sin within 2 ulp");
+        check(worstUlp({OpCode::Cos, 0.0}, inputs, [](double y) { return std::cos(y); }) <= 2, "cos within 2 ulp");
+    }
+    // Beyond 1e6 the kernel uses libm itself.
+    std::vector<double> large = logUniform(rng, std::log(1e6), 700.0, true);
+    check(worstUlp({OpCode::Sin, 0.0}, large, [](double y) { return std::sin(y); }) == 0, "sin beyond 1e6 matches libm");
+    check(worstUlp({OpCode::Cos, 0.0}, large, [](double y) { return std::cos(y); }) == 0, "cos beyond 1e6 matches libm");
+
+    // |y|^4 stays a normal number over this range.
+    std::vector<double> bases = logUniform(rng, -177.0, 177.0, true);
+    for (int exponent = -4; exponent <= 4; ++exponent) {
+        const uint64_t bound = exponent == -4 ? 3 : 2;
+        const double c = exponent;
+        check(worstUlp({OpCode::Pow, c}, bases, [c](double y) { return std::pow(y, c); }) <= bound,
+              "pow " + std::to_string(exponent) + " within " + std::to_string(bound) + " ulp");
+    }
+    check(worstUlp({OpCode::Pow, 2.5}, positive, [](double y) { return std::pow(y, 2.5); }) == 0, "non-integral exponents match std::pow");
+
+    if (failures == 0) {
+        std::printf("kernel_test passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
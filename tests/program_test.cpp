@@ -0,0 +1,182 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "program.h"
+
+// Instruction parsing and formatting, canonical folding and hashing of
+// programs.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+bool samePrograms(const Program& a, const Program& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t k = 0; k < a.size(); ++k) {
+        if (a[k].code != b[k].code || a[k].operand != b[k].operand) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameBits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Checks that `text` parses to `expected` and normalizes to `spelling`.
+void checkParses(const std::string& text, Op expected, const std::string& spelling) {
+    std::string normalized;
+    try {
+        Op op = parseInstruction(text, normalized);
+        check(op.code == expected.code && sameBits(op.operand, expected.operand), "'" + text + "' parses");
+        check(normalized == spelling, "'" + text + "' normalizes to '" + spelling + "', not '" + normalized + "'");
+    } catch (const std::invalid_argument& error) {
+        check(false, "'" + text + "' parses: " + error.what());
+    }
+}
+
+void checkRejects(const std::string& text) {
+    std::string normalized;
+    bool rejected = false;
+    try {
+        parseInstruction(text, normalized);
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    check(rejected, "'" + text + "' is rejected");
+}
+
+Program canonical(const Program& program) {
+    Program result;
+    canonicalizeProgram(program, result);
+    return result;
+}
+
+} // namespace
+
+int main() {
+    checkParses("y = y + 1", {OpCode::Add, 1.0}, "y = y + 1");
+    checkParses("y=y+1", {OpCode::Add, 1.0}, "y = y + 1");
+    checkParses("  y  =  y  *  2  ", {OpCode::Mul, 2.0}, "y = y * 2");
+    checkParses("y =\ty / 2", {OpCode::Div, 2.0}, "y = y / 2");
+    checkParses("y = y - 1", {OpCode::Sub, 1.0}, "y = y - 1");
+    checkParses("y = y ^ 3", {OpCode::Pow, 3.0}, "y = y ^ 3");
+    checkParses("y = y + -2.5", {OpCode::Add, -2.5}, "y = y + -2.5");
+    checkParses("y = y - -0.125", {OpCode::Sub, -0.125}, "y = y - -0.125");
+    checkParses("y = y * 1.5e-3", {OpCode::Mul, 1.5e-3}, "y = y * 1.5e-3");
+    checkParses("y = y / 2E+10", {OpCode::Div, 2e10}, "y = y / 2E+10");
+    checkParses("y = y + +4", {OpCode::Add, 4.0}, "y = y + 4");
+    checkParses("y = ln(y)", {OpCode::Ln, 0.0}, "y = ln(y)");
+    checkParses("y=sin( y )", {OpCode::Sin, 0.0}, "y = sin(y)");
+    checkParses("y = cos (y)", {OpCode::Cos, 0.0}, "y = cos(y)");
+    checkParses("y = -7", {OpCode::Set, -7.0}, "y = -7");
+    checkParses("y = 6.02e23", {OpCode::Set, 6.02e23}, "y = 6.02e23");
+
+    checkRejects("");
+    checkRejects("y");
+    checkRejects("y = ");
+    checkRejects("x = y + 1");
+    checkRejects("y = x");
+    checkRejects("y = sinh(y)");
+    checkRejects("y = sin(x)");
+    checkRejects("y = sin(y");
+    checkRejects("y = tan(y)");
+    checkRejects("y = y % 2");
+    checkRejects("y = y +");
+    checkRejects("y = y + 1x");
+    checkRejects("y = y + 1 2");
+    checkRejects("y = ln(y) + 1");
+    checkRejects("y = 3;");
+    checkRejects("y = y + e5");
+
+    // Random operands, including extremes, survive formatting and parsing
+    // bit for bit.
+    std::mt19937_64 rng(7);
+    std::vector<double> operands = {0.0, -0.0, 1.0, -1.0, 0.1, 1e-320, -1.7976931348623157e308, 123456789012345680.0};
+    for (int i = 0; i < 1000; ++i) {
+        uint64_t bits = rng();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        if (std::isfinite(value)) {
+            operands.push_back(value);
+        }
+    }
+    const OpCode codes[] = {OpCode::Add, OpCode::Sub, OpCode::Mul, OpCode::Div, OpCode::Pow, OpCode::Set};
+    for (OpCode code : codes) {
+        for (double operand : operands) {
+            const Op op{code, operand};
+            const std::string text = formatInstruction(op);
+            std::string normalized;
+            Op parsed{OpCode::Ln, 0.0};
+            try {
+                parsed = parseInstruction(text, normalized);
+            } catch (const std::invalid_argument& error) {
+                check(false, "'" + text + "' parses back: " + error.what());
+                continue;
+            }
+            check(parsed.code == code && sameBits(parsed.operand, operand) && normalized == text, "'" + text + "' round trips");
+        }
+    }
+    for (OpCode code : {OpCode::Ln, OpCode::Sin, OpCode::Cos}) {
+        const std::string text = formatInstruction({code, 0.0});
+        std::string normalized;
+        check(parseInstruction(text, normalized).code == code && normalized == text, "'" + text + "' round trips");
+    }
+
+    check(samePrograms(canonical({{OpCode::Add, 1.0}, {OpCode::Add, 2.0}}), {{OpCode::Add, 3.0}}), "+a, +b folds into one addition");
+    check(samePrograms(canonical({{OpCode::Add, 2.0}, {OpCode::Sub, 0.5}}), {{OpCode::Add, 1.5}}), "+a, -b folds into one addition");
+    check(canonical({{OpCode::Add, 2.0}, {OpCode::Sub, 2.0}}).empty(), "+c, -c cancels");
+    check(canonical({{OpCode::Mul, 4.0}, {OpCode::Div, 4.0}}).empty(), "*c, /c cancels");
+    check(samePrograms(canonical({{OpCode::Mul, 2.0}, {OpCode::Div, 4.0}}), {{OpCode::Mul, 0.5}}), "*a, /b folds into one multiplication");
+    check(samePrograms(canonical({{OpCode::Sin, 0.0}, {OpCode::Add, 1.0}, {OpCode::Set, 3.0}}), {{OpCode::Set, 3.0}}), "Set discards the ops before it");
+    check(samePrograms(canonical({{OpCode::Set, 3.0}, {OpCode::Add, 1.0}, {OpCode::Mul, 2.0}}), {{OpCode::Set, 8.0}}), "Set absorbs the arithmetic after it");
+    check(samePrograms(canonical({{OpCode::Pow, 1.0}, {OpCode::Cos, 0.0}}), {{OpCode::Cos, 0.0}}), "^1 is dropped");
+    check(samePrograms(canonical({{OpCode::Pow, 2.0}}), {{OpCode::Pow, 2.0}}), "other powers stay");
+    check(samePrograms(canonical({{OpCode::Add, 1.0}, {OpCode::Sin, 0.0}, {OpCode::Add, 1.0}}), {{OpCode::Add, 1.0}, {OpCode::Sin, 0.0}, {OpCode::Add, 1.0}}),
+          "constants are not folded across other ops");
+
+    const Program a = canonical({{OpCode::Add, 1.0}, {OpCode::Add, 2.0}, {OpCode::Sin, 0.0}});
+    const Program b = canonical({{OpCode::Add, 3.0}, {OpCode::Sin, 0.0}});
+    check(hashProgram(a, 0) == hashProgram(b, 0), "equivalent programs hash alike once canonical");
+    check(hashProgram({{OpCode::Add, 0.0}}, 0) == hashProgram({{OpCode::Add, -0.0}}, 0), "0 and -0 hash alike");
+    check(hashProgram({{OpCode::Set, NAN}}, 0) == hashProgram({{OpCode::Set, -NAN}}, 0), "every NaN hashes alike");
+
+    const std::vector<Program> distinct = {
+        {},
+        {{OpCode::Add, 1.0}},
+        {{OpCode::Add, 2.0}},
+        {{OpCode::Sub, 1.0}},
+        {{OpCode::Mul, 1.0}},
+        {{OpCode::Sin, 0.0}},
+        {{OpCode::Cos, 0.0}},
+        {{OpCode::Sin, 0.0}, {OpCode::Cos, 0.0}},
+        {{OpCode::Cos, 0.0}, {OpCode::Sin, 0.0}},
+        {{OpCode::Add, 1.0}, {OpCode::Add, 1.0}},
+        {{OpCode::Add, 1.0}, {OpCode::Add, 1.0000000000000002}},
+    };
+    for (size_t i = 0; i < distinct.size(); ++i) {
+        for (size_t j = i + 1; j < distinct.size(); ++j) {
+            check(hashProgram(distinct[i], 0) != hashProgram(distinct[j], 0), "programs " + std::to_string(i) + " and " + std::to_string(j) + " hash differently");
+        }
+    }
+    check(hashProgram(distinct[1], 0) != hashProgram(distinct[1], 1), "the seed changes the hash");
+
+    if (failures == 0) {
+        std::printf("program_test passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "geneticalgo.h"
+
+// Racing abandons hopeless children early but must not change selection:
+// runs with racing on and off keep the same survivors with the same scores.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+bool sameBits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+bool sameIndividuals(const std::vector<Function>& a, const std::vector<Function>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        const Program& pa = a[i].getProgram();
+        const Program& pb = b[i].getProgram();
+        if (!sameBits(a[i].getScore(), b[i].getScore()) || pa.size() != pb.size()) {
+            return false;
+        }
+        for (size_t k = 0; k < pa.size(); ++k) {
+            if (pa[k].code != pb[k].code || !sameBits(pa[k].operand, pb[k].operand)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    std::vector<double> x_values;
+    std::vector<double> desired;
+    for (int i = 0; i < 4000; ++i) {
+        x_values.push_back(-2.0 + i * 0.002);
+        desired.push_back(2.0 * std::sin(x_values.back()) + 0.3 * x_values.back());
+    }
+    std::span<const double> x(x_values);
+    std::span<const double> d(desired);
+
+    // Individuals whose score is NaN (ln of negative values), 0 (every output
+    // infinite) or NaN on part of the data only.
+    const std::vector<Program> degenerate = {
+        {{OpCode::Set, -1.0}, {OpCode::Ln, 0.0}},
+        {{OpCode::Mul, 1e300}, {OpCode::Mul, 1e300}},
+        {{OpCode::Ln, 0.0}, {OpCode::Add, 1.0}},
+        {{OpCode::Div, 0.0}},
+    };
+
+    const int generations = 12;
+    for (int variant = 0; variant < 4; ++variant) {
+        GeneticAlgorithmOptions options;
+        options.seed = 21 + variant;
+        options.thread_count = 1 + variant % 2;
+        if (variant >= 2) {
+            options.warm_start = degenerate;
+        }
+        const int population = (variant == 3) ? 61 : 100;
+        const std::string name = "variant " + std::to_string(variant);
+
+        GeneticAlgorithm full(x, d, population, generations, options);
+        options.racing = true;
+        GeneticAlgorithm raced(x, d, population, generations, options);
+        full.initialize();
+        raced.initialize();
+        bool identical = true;
+        for (int generation = 0; generation < generations && identical; ++generation) {
+            full.step();
+            raced.step();
+            identical = sameBits(full.getBestScore(), raced.getBestScore())
+                && sameIndividuals(full.getTopIndividuals(population), raced.getTopIndividuals(population));
+            check(identical, name + ": racing keeps the same survivors after generation " + std::to_string(generation));
+        }
+        check(raced.getSkippedSamples() > 0, name + ": racing skipped samples");
+        check(full.getSkippedSamples() == 0, name + ": no samples skipped without racing");
+    }
+
+    if (failures == 0) {
+        std::printf("racing_test passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}